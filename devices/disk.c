@@ -84,7 +84,7 @@ static void reset_channel (struct channel *);
 static bool check_device_type (struct disk *);
 static void identify_ata_device (struct disk *);
 
-static void select_sector (struct disk *, disk_sector_t);
+static void select_sector (struct disk *, disk_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -216,7 +216,7 @@ disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) {
 
 	c = d->channel;
 	lock_acquire (&c->lock);
-	select_sector (d, sec_no);
+	select_sector (d, sec_no, 1);
 	issue_pio_command (c, CMD_READ_SECTOR_RETRY);
 	sema_down (&c->completion_wait);
 	if (!wait_while_busy (d))
@@ -226,6 +226,69 @@ disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) {
 	lock_release (&c->lock);
 }
 
+/* Reads the CNT consecutive sectors starting at SEC_NO from disk
+   D with a single command, sector I into BUFFERS[I], each of which
+   must have room for DISK_SECTOR_SIZE bytes.  CNT may be at most
+   DISK_MAX_SECTORS.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_readv (struct disk *d, disk_sector_t sec_no, void *const buffers[],
+		size_t cnt) {
+	struct channel *c;
+	size_t i;
+
+	ASSERT (d != NULL);
+	ASSERT (buffers != NULL);
+
+	c = d->channel;
+	lock_acquire (&c->lock);
+	select_sector (d, sec_no, cnt);
+	issue_pio_command (c, CMD_READ_SECTOR_RETRY);
+	for (i = 0; i < cnt; i++) {
+		/* The disk interrupts once per sector it has ready. */
+		sema_down (&c->completion_wait);
+		if (!wait_while_busy (d))
+			PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name,
+					sec_no + (disk_sector_t) i);
+		input_sector (c, buffers[i]);
+	}
+	d->read_cnt += cnt;
+	lock_release (&c->lock);
+}
+
+/* Writes the CNT consecutive sectors starting at SEC_NO to disk D
+   with a single command, sector I from BUFFERS[I], each of which
+   must contain DISK_SECTOR_SIZE bytes.  CNT may be at most
+   DISK_MAX_SECTORS.  Returns after the disk has acknowledged
+   receiving the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_writev (struct disk *d, disk_sector_t sec_no,
+		const void *const buffers[], size_t cnt) {
+	struct channel *c;
+	size_t i;
+
+	ASSERT (d != NULL);
+	ASSERT (buffers != NULL);
+
+	c = d->channel;
+	lock_acquire (&c->lock);
+	select_sector (d, sec_no, cnt);
+	issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
+	for (i = 0; i < cnt; i++) {
+		if (!wait_while_busy (d))
+			PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name,
+					sec_no + (disk_sector_t) i);
+		output_sector (c, buffers[i]);
+		/* The disk interrupts once it has taken each sector. */
+		sema_down (&c->completion_wait);
+	}
+	d->write_cnt += cnt;
+	lock_release (&c->lock);
+}
+
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
    DISK_SECTOR_SIZE bytes.  Returns after the disk has
    acknowledged receiving the data.
@@ -240,7 +303,7 @@ disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer) {
 
 	c = d->channel;
 	lock_acquire (&c->lock);
-	select_sector (d, sec_no);
+	select_sector (d, sec_no, 1);
 	issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
 	if (!wait_while_busy (d))
 		PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
@@ -402,17 +465,18 @@ print_ata_string (char *string, size_t size) {
 }
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and CNT to the disk's sector selection registers
+   for a transfer of CNT sectors.  (We use LBA mode.) */
 static void
-select_sector (struct disk *d, disk_sector_t sec_no) {
+select_sector (struct disk *d, disk_sector_t sec_no, size_t cnt) {
 	struct channel *c = d->channel;
 
-	ASSERT (sec_no < d->capacity);
-	ASSERT (sec_no < (1UL << 28));
+	ASSERT (cnt > 0 && cnt <= DISK_MAX_SECTORS);
+	ASSERT (sec_no + cnt <= d->capacity);
+	ASSERT (sec_no + cnt <= (1UL << 28));
 
 	select_device_wait (d);
-	outb (reg_nsect (c), 1);
+	outb (reg_nsect (c), cnt);    /* 0 stands for DISK_MAX_SECTORS. */
 	outb (reg_lbal (c), sec_no);
 	outb (reg_lbam (c), sec_no >> 8);
 	outb (reg_lbah (c), (sec_no >> 16));
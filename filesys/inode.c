@@ -6,6 +6,7 @@
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
@@ -33,9 +34,26 @@ struct inode {
 	int open_cnt;                       /* Number of openers. */
 	bool removed;                       /* True if deleted, false otherwise. */
 	int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+	uint64_t version;                   /* See inode_version (). */
 	struct inode_disk data;             /* Inode content. */
 };
 
+/* Last version handed out to an inode, and the lock that keeps two
+ * inodes written at once from getting the same one. */
+static uint64_t last_version;
+static struct lock version_lock;
+
+/* Returns a version no inode has had yet. */
+static uint64_t
+next_version (void) {
+	uint64_t version;
+
+	lock_acquire (&version_lock);
+	version = ++last_version;
+	lock_release (&version_lock);
+	return version;
+}
+
 /* Returns the disk sector that contains byte offset POS within
  * INODE.
  * Returns -1 if INODE does not contain data for a byte at offset
@@ -57,6 +75,7 @@ static struct list open_inodes;
 void
 inode_init (void) {
 	list_init (&open_inodes);
+	lock_init (&version_lock);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -125,6 +144,7 @@ inode_open (disk_sector_t sector) {
 	inode->open_cnt = 1;
 	inode->deny_write_cnt = 0;
 	inode->removed = false;
+	inode->version = next_version ();
 	disk_read (filesys_disk, inode->sector, &inode->data);
 	return inode;
 }
@@ -283,6 +303,8 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 	}
 	free (bounce);
 
+	if (bytes_written > 0)
+		inode->version = next_version ();
 	return bytes_written;
 }
 
@@ -305,6 +327,15 @@ inode_allow_write (struct inode *inode) {
 	inode->deny_write_cnt--;
 }
 
+/* Returns the version of INODE's contents. It is new each time the inode
+ * is opened into memory and after each write, and no two inodes ever have
+ * the same one, so data cached under an inode and its version is valid as
+ * long as the version stays the same. */
+uint64_t
+inode_version (const struct inode *inode) {
+	return inode->version;
+}
+
 /* Returns the length, in bytes, of INODE's data. */
 off_t
 inode_length (const struct inode *inode) {
@@ -2,6 +2,7 @@
 #define FILESYS_INODE_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include "filesys/off_t.h"
 #include "devices/disk.h"
 
@@ -19,5 +20,6 @@ off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
+uint64_t inode_version (const struct inode *);
 
 #endif /* filesys/inode.h */
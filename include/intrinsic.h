@@ -11,6 +11,20 @@ static __inline void lcr3(uint64_t val) {
 	__asm __volatile("movq %0, %%cr3" : : "r" (val));
 }
 
+/* Reads and writes control register 4, which enables optional
+   paging features such as global pages and PCIDs. */
+__attribute__((always_inline))
+static __inline uint64_t rcr4(void) {
+	uint64_t val;
+	__asm __volatile("movq %%cr4,%0" : "=r" (val));
+	return val;
+}
+
+__attribute__((always_inline))
+static __inline void lcr4(uint64_t val) {
+	__asm __volatile("movq %0, %%cr4" : : "r" (val) : "memory");
+}
+
 __attribute__((always_inline))
 static __inline void lgdt(const struct desc_ptr *dtr) {
 	__asm __volatile("lgdt %0" : : "m" (*dtr));
@@ -36,6 +50,15 @@ static __inline void invlpg(uint64_t addr) {
 	__asm __volatile("invlpg (%0)" : : "r" (addr) : "memory");
 }
 
+/* Executes CPUID for LEAF and stores the resulting registers into
+   REGS[0..3] as EAX, EBX, ECX, EDX. */
+__attribute__((always_inline))
+static __inline void cpuid(uint32_t leaf, uint32_t regs[4]) {
+	__asm __volatile("cpuid"
+			: "=a" (regs[0]), "=b" (regs[1]), "=c" (regs[2]), "=d" (regs[3])
+			: "a" (leaf), "c" (0));
+}
+
 __attribute__((always_inline))
 static __inline uint64_t read_eflags(void) {
 	uint64_t rflags;
@@ -36,6 +36,13 @@ enum {
 
 	SYS_MOUNT,
 	SYS_UMOUNT,
+
+	/* Virtual memory extensions. */
+	SYS_MSYNC,                  /* Write back a memory mapping. */
+	SYS_SET_RSS_LIMIT,          /* Limit the resident pages of a process. */
+	SYS_MADVISE,                /* Give access hints for a memory range. */
+	SYS_MLOCK,                  /* Keep a memory range resident. */
+	SYS_MUNLOCK,                /* Let a locked memory range be evicted. */
 };
 
 #endif /* lib/syscall-nr.h */
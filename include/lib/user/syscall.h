@@ -13,6 +13,21 @@ typedef int pid_t;
 typedef int off_t;
 #define MAP_FAILED ((void *) NULL)
 
+/* Flags for mmap(), ORed into its WRITABLE argument. */
+#define MAP_ANONYMOUS 0x2       /* Zero-filled memory instead of a file,
+                                   shared with children forked later.
+                                   FD and OFFSET are ignored. */
+#define MAP_PRIVATE 0x4         /* Copy-on-write file mapping: writes stay
+                                   in this process and never reach the
+                                   file. Not with MAP_ANONYMOUS. */
+
+/* Advice for madvise(). */
+#define MADV_NORMAL 0           /* No particular access pattern. */
+#define MADV_RANDOM 1           /* Random access: no readahead. */
+#define MADV_SEQUENTIAL 2       /* Sequential access: read far ahead. */
+#define MADV_WILLNEED 3         /* Will be used soon: load it now. */
+#define MADV_DONTNEED 4         /* Not needed: drop it now. */
+
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
@@ -41,6 +56,11 @@ int dup2(int oldfd, int newfd);
 /* Project 3 and optionally project 4. */
 void *mmap (void *addr, size_t length, int writable, int fd, off_t offset);
 void munmap (void *addr);
+int msync (void *addr, size_t length);
+size_t set_rss_limit (size_t pages);
+int madvise (void *addr, size_t length, int advice);
+int mlock (const void *addr, size_t length);
+int munlock (const void *addr, size_t length);
 
 /* Project 4 only. */
 bool chdir (const char *dir);
@@ -2,24 +2,68 @@
 #define THREAD_MMU_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include "threads/pte.h"
 
 typedef bool pte_for_each_func (uint64_t *pte, void *va, void *aux);
 
+/* Most single pages a tlb_gather invalidates one by one. Past that, one
+ * reload of CR3 is cheaper than the invlpgs. */
+#define TLB_GATHER_MAX 32
+
+/* A batch of TLB invalidations for PML4, gathered by the *_batch ()
+ * functions below while they change entries and performed together by
+ * tlb_gather_finish (). Changes to other page tables are invalidated on
+ * the spot, which costs nothing unless that page table is active. */
+struct tlb_gather {
+	uint64_t *pml4;
+	size_t cnt;                       /* Entries of PAGES in use. */
+	bool full;                        /* Overflowed: reload CR3. */
+	uint64_t pages[TLB_GATHER_MAX];
+};
+
 uint64_t *pml4e_walk (uint64_t *pml4, const uint64_t va, int create);
 uint64_t *pml4_create (void);
+bool pml4_map_range (uint64_t *pml4, uint64_t va, uint64_t pa, uint64_t size,
+		uint64_t perm);
 bool pml4_for_each (uint64_t *, pte_for_each_func *, void *);
 void pml4_destroy (uint64_t *pml4);
 void pml4_activate (uint64_t *pml4);
+void tlb_init (void);
 void *pml4_get_page (uint64_t *pml4, const void *upage);
 bool pml4_set_page (uint64_t *pml4, void *upage, void *kpage, bool rw);
+bool pml4_set_huge_page (uint64_t *pml4, void *upage, void *kpage, bool rw);
+bool pml4_is_huge_page (uint64_t *pml4, const void *upage);
 void pml4_clear_page (uint64_t *pml4, void *upage);
 bool pml4_is_dirty (uint64_t *pml4, const void *upage);
 void pml4_set_dirty (uint64_t *pml4, const void *upage, bool dirty);
+void pml4_set_writable (uint64_t *pml4, const void *upage, bool writable);
 bool pml4_is_accessed (uint64_t *pml4, const void *upage);
 void pml4_set_accessed (uint64_t *pml4, const void *upage, bool accessed);
 
+void tlb_gather_init (struct tlb_gather *tlb, uint64_t *pml4);
+void tlb_gather_finish (struct tlb_gather *tlb);
+void pml4_clear_page_batch (uint64_t *pml4, void *upage,
+		struct tlb_gather *tlb);
+void pml4_set_dirty_batch (uint64_t *pml4, const void *upage, bool dirty,
+		struct tlb_gather *tlb);
+void pml4_set_writable_batch (uint64_t *pml4, const void *upage,
+		bool writable, struct tlb_gather *tlb);
+void pml4_set_accessed_batch (uint64_t *pml4, const void *upage,
+		bool accessed, struct tlb_gather *tlb);
+
+bool pml4_set_pages (uint64_t *pml4, void *upage, void **kpages, size_t cnt,
+		bool rw);
+void pml4_clear_range (uint64_t *pml4, void *start, void *end,
+		struct tlb_gather *tlb);
+void pml4_protect_range (uint64_t *pml4, void *start, void *end,
+		bool writable, struct tlb_gather *tlb);
+size_t pml4_collect_range (uint64_t *pml4, void *start, void *end,
+		uint64_t bits, bool clear, struct tlb_gather *tlb);
+size_t pml4_remove_range (uint64_t *pml4, void *start, void *end);
+bool pml4_discard_table (uint64_t *pml4, void *va);
+
 #define is_writable(pte) (*(pte) & PTE_W)
 #define is_user_pte(pte) (*(pte) & PTE_U)
 #define is_kern_pte(pte) (!is_user_pte (pte))
@@ -122,6 +122,8 @@ struct thread {
 #ifdef VM
 	/* Table for whole virtual memory owned by thread. */
 	struct supplemental_page_table spt;
+	void *user_rsp;                     /* User rsp at system call entry. */
+	size_t rss_limit;                   /* Most resident pages, 0 if none. */
 #endif
 
 	/* Owned by thread.c. */
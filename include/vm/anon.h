@@ -1,13 +1,57 @@
 #ifndef VM_ANON_H
 #define VM_ANON_H
 #include "vm/vm.h"
+#include "vm/zswap.h"
 struct page;
+struct file_region;
 enum vm_type;
 
+/* Value of anon_page.slot for a page that has no swap slot. */
+#define SWAP_SLOT_NONE SIZE_MAX
+
 struct anon_page {
+	size_t slot;           /* Swap slot holding the page's contents. */
+	struct zswap_handle zswap;  /* ...or its compressed copy in memory. */
+	struct anon_shared *shared; /* Object of a shared mapping, or NULL. */
+	struct file_region *origin; /* Region a VM_TEXT page was read from, on
+	                               which it holds a reference, or NULL. */
+};
+
+/* One page of a struct anon_shared. */
+struct anon_shared_page {
+	struct frame *frame;   /* Frame holding the page, or NULL. Protected by
+	                          frame_lock. */
+	struct anon_page store; /* Where the page is kept while not in a frame:
+	                           only SLOT and ZSWAP are used. */
+};
+
+/* Backing object of a shared anonymous mapping, made by mmap () with
+ * MAP_ANONYMOUS and inherited across fork (). The pages of every process
+ * that maps it, all at the same address, map the same frames writable,
+ * and a page evicted goes to swap once, here, for all of them. It is the
+ * VM_AUX_REF aux of the mapping's uninit pages, and each page of it keeps
+ * a reference. When the last process that maps a frame lets go of it
+ * without evicting it, the page is saved to the object's store and the
+ * frame freed; only if that fails does the frame stay with the object. */
+struct anon_shared {
+	struct vm_aux aux;
+	uint8_t *upage;        /* First page of the mapping. */
+	size_t page_cnt;
+	struct anon_shared_page pages[];
 };
 
 void vm_anon_init (void);
 bool anon_initializer (struct page *page, enum vm_type type, void *kva);
+bool anon_swap_out_cluster (struct page *pages[], size_t cnt);
+void anon_discard (struct page *page);
+bool anon_copy_store (struct page *dst, const struct page *src);
+void anon_set_readahead (size_t pages);
+void anon_print_stats (void);
+struct anon_shared *anon_shared_create (void *upage, size_t page_cnt);
+bool anon_shared_load (struct page *page, void *aux);
+struct frame **anon_shared_frame (struct page *page);
+bool anon_shared_save (struct page *page, const void *kva);
+void anon_text_revert (struct page *page);
+void *do_mmap_anon (void *addr, size_t length, int writable);
 
 #endif
@@ -1,17 +1,45 @@
 #ifndef VM_FILE_H
 #define VM_FILE_H
 #include "filesys/file.h"
+#include "threads/synch.h"
 #include "vm/vm.h"
 
 struct page;
 enum vm_type;
 
+/* A run of pages filled from a file: one segment of an executable, or one
+ * mmap. It is the shared VM_AUX_REF aux of the run's uninit pages, and
+ * file-backed pages keep a reference for writeback and reloading.
+ *
+ * It also drives fault-around. A fault that continues where the last one
+ * left off reads the following pages in the same file_read_at () and maps
+ * them too. The window doubles while all of the pages read ahead get
+ * used, and halves when most of them are never touched. That state is
+ * kept per process, in the struct vma_readahead of the mapping's area. */
+struct file_region {
+	struct vm_aux aux;
+	struct file *file;          /* Own handle on the file. */
+	off_t ofs;                  /* File offset of UPAGE. */
+	uint8_t *upage;             /* First page of the region. */
+	size_t page_cnt;            /* Number of pages. */
+	size_t read_bytes;          /* Bytes from the file; the rest is zero. */
+
+	struct lock lock;           /* Orders reads and writes of the file. */
+};
+
 struct file_page {
+	struct file_region *region; /* Where the page is loaded from. */
 };
 
 void vm_file_init (void);
+void file_writeback_init (void);
 bool file_backed_initializer (struct page *page, enum vm_type type, void *kva);
+struct file_region *file_region_create (struct file *file, off_t ofs,
+		void *upage, size_t page_cnt, size_t read_bytes);
+bool file_region_load (struct page *page, void *aux);
 void *do_mmap(void *addr, size_t length, int writable,
 		struct file *file, off_t offset);
 void do_munmap (void *va);
+bool do_msync (void *addr, size_t length);
+void file_print_stats (void);
 #endif
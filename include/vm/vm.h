@@ -1,7 +1,9 @@
 #ifndef VM_VM_H
 #define VM_VM_H
 #include <stdbool.h>
+#include <stdint.h>
 #include "threads/palloc.h"
+#include "threads/synch.h"
 
 enum vm_type {
 	/* page not initialized */
@@ -19,14 +21,43 @@ enum vm_type {
 	 * markers, until the value is fit in the int. */
 	VM_MARKER_0 = (1 << 3),
 	VM_MARKER_1 = (1 << 4),
+	VM_MARKER_2 = (1 << 5),
+
+	/* The initializer's AUX is a struct vm_aux that the page holds a
+	 * reference on. */
+	VM_AUX_REF = VM_MARKER_0,
+
+	/* Anonymous page whose aux is a struct file_region and which is all
+	 * file data: a read-only executable page, or a page of a private file
+	 * mapping. Its frame can be shared by every process that maps the same
+	 * file page, until one of them writes to it. */
+	VM_TEXT = VM_MARKER_1,
+
+	/* Anonymous page of a shared mapping, whose aux is the struct
+	 * anon_shared it belongs to. */
+	VM_SHARED = VM_MARKER_2,
 
 	/* DO NOT EXCEED THIS VALUE. */
 	VM_MARKER_END = (1 << 31),
 };
 
+/* Header of a reference-counted initializer argument, shared by many uninit
+ * pages (e.g. every page of one ELF segment). A page whose type carries
+ * VM_AUX_REF owns one reference, which is dropped once the page has been
+ * initialized or destroyed. RELEASE frees the enclosing object.
+ * FAULT_AROUND, if set, is called once a page fault has tried to load
+ * page VA from the aux: to load neighbouring pages in the same fault if
+ * it succeeded, and to free what the attempt left behind either way. */
+struct vm_aux {
+	int ref_cnt;
+	void (*release) (struct vm_aux *);
+	void (*fault_around) (struct vm_aux *, void *va);
+};
+
 #include "vm/uninit.h"
 #include "vm/anon.h"
 #include "vm/file.h"
+#include "vm/vma.h"
 #ifdef EFILESYS
 #include "filesys/page_cache.h"
 #endif
@@ -36,6 +67,24 @@ struct thread;
 
 #define VM_TYPE(type) ((type) & 7)
 
+/* Access pattern hints given with madvise (). The values are those of
+ * the MADV_* constants in lib/user/syscall.h. */
+enum vm_advice {
+	VM_ADV_NORMAL = 0,     /* No hint: adaptive readahead. */
+	VM_ADV_RANDOM = 1,     /* No readahead. */
+	VM_ADV_SEQUENTIAL = 2, /* Full readahead, pages behind evicted early. */
+	VM_ADV_WILLNEED = 3,   /* Load the pages now. */
+	VM_ADV_DONTNEED = 4,   /* Drop the pages now. */
+};
+
+/* Flags that mmap () takes ORed into its WRITABLE argument. The values
+ * are those of the MAP_* constants in lib/user/syscall.h. */
+enum vm_map_flags {
+	VM_MAP_WRITE = 0x1,    /* The pages may be written. */
+	VM_MAP_ANON = 0x2,     /* Zero-filled memory, shared across fork (). */
+	VM_MAP_PRIVATE = 0x4,  /* Copy-on-write file mapping. */
+};
+
 /* The representation of "page".
  * This is kind of "parent class", which has four "child class"es, which are
  * uninit_page, file_page, anon_page, and page cache (project4).
@@ -46,6 +95,11 @@ struct page {
 	struct frame *frame;   /* Back reference for frame */
 
 	/* Your implementation */
+	struct thread *owner;  /* Thread whose address space holds the page. */
+	bool writable;         /* May the user write to the page? */
+	struct page *next_sharer; /* Next page mapping the same frame. */
+	enum vm_advice advice; /* VM_ADV_NORMAL, _RANDOM or _SEQUENTIAL. */
+	bool locked;           /* mlock ()ed: its frame is never evicted. */
 
 	/* Per-type data are binded into the union.
 	 * Each function automatically detects the current union */
@@ -59,10 +113,42 @@ struct page {
 	};
 };
 
-/* The representation of "frame" */
+/* The representation of "frame".
+ * There is one for every page of the user pool, kept in a global table
+ * indexed by the frame's position in the pool. A frame is in use while
+ * PAGE is non-null. After fork, several pages may map one frame
+ * copy-on-write: PAGE is then the head of a list chained through
+ * next_sharer, and the frame is mapped read-only while REF_CNT > 1. */
 struct frame {
 	void *kva;
 	struct page *page;
+	int ref_cnt;           /* Number of pages sharing the frame. */
+	struct text_page *text; /* Entry in the text page cache, or NULL. */
+	int64_t last_use;      /* Tick the page was last seen referenced. */
+	bool referenced;       /* Accessed bit taken by the working-set
+	                          sampler, not yet seen by the clock. */
+	bool busy;             /* In disk I/O with frame_lock released. */
+	bool pinned;           /* Never chosen as an eviction victim. */
+	int pin_cnt;           /* System calls copying to or from the page,
+	                          which keep it resident meanwhile. */
+	unsigned ksm_sum;      /* Checksum of the contents when ksmd last
+	                          looked. */
+};
+
+/* Most pages that one vm_pin_buffer () call may pin. */
+#define VM_PIN_MAX 8
+
+/* The frames pinned by a vm_pin_buffer () call, for vm_unpin_buffer (). */
+struct vm_pin {
+	struct frame *frames[VM_PIN_MAX];
+	size_t cnt;
+};
+
+/* Frame eviction policies, chosen with the -evict kernel option. */
+enum vm_evict_policy {
+	EVICT_CLOCK,           /* Second chance on the accessed bit. */
+	EVICT_ECLOCK,          /* Enhanced clock, prefers clean pages. */
+	EVICT_WSCLOCK,         /* Clock over the working-set age of pages. */
 };
 
 /* The function table for page operations.
@@ -81,10 +167,30 @@ struct page_operations {
 #define destroy(page) \
 	if ((page)->operations->destroy) (page)->operations->destroy (page)
 
+/* Number of entries in every level of the supplemental page table. This is
+ * the fan-out of one x86-64 page-table page, so the SPT is indexed exactly
+ * like the pml4 with PML4 (), PDPE (), PDX () and PTX (). */
+#define SPT_ENTRY_CNT 512
+
 /* Representation of current process's memory space.
- * We don't want to force you to obey any specific design for this struct.
- * All designs up to you for this. */
+ *
+ * A four level radix tree shaped like the hardware page table. Every level
+ * is one page-sized array: of child pointers in the upper three, and of
+ * pointers to the struct page of each of the SPT_ENTRY_CNT virtual pages it
+ * covers, or NULL, in a leaf. The pages themselves are fixed-size slots
+ * packed into slabs of kernel pages, so a reserved page costs a slot and a
+ * pointer, and no heap allocation of its own. The slabs belong to the
+ * table, like its directories, and only its owner changes either. */
 struct supplemental_page_table {
+	struct lock lock;      /* Held while a fault, fork or madvise ()-like
+	                          call works on the table's pages. */
+	void **root;           /* PML4-level directory, or NULL while empty. */
+	struct list slabs;     /* Slabs of the pages with a free slot. */
+	struct vma_tree vmas;  /* Areas the pages lie in. */
+	size_t page_cnt;       /* Number of pages. */
+	size_t rss;            /* Pages mapped to a frame of the table. */
+	size_t ws_cnt;         /* Pages referenced in sampling pass WS_GEN. */
+	unsigned ws_gen;
 };
 
 #include "threads/thread.h"
@@ -97,7 +203,30 @@ struct page *spt_find_page (struct supplemental_page_table *spt,
 bool spt_insert_page (struct supplemental_page_table *spt, struct page *page);
 void spt_remove_page (struct supplemental_page_table *spt, struct page *page);
 
+void vm_aux_init (struct vm_aux *aux, void (*release) (struct vm_aux *));
+struct vm_aux *vm_aux_get (struct vm_aux *aux);
+void vm_aux_put (struct vm_aux *aux);
+struct vm_aux *vm_page_aux (struct page *page);
+
 void vm_init (void);
+void vm_print_stats (void);
+void vm_tick (void);
+size_t vm_working_set (struct thread *t);
+void vm_frame_lock (void);
+void vm_frame_unlock (void);
+size_t vm_frame_cnt (void);
+struct frame *vm_frame_at (size_t idx);
+bool vm_write_back (struct page *page);
+bool vm_advise (void *addr, size_t length, enum vm_advice advice);
+bool vm_lock_range (void *addr, size_t length);
+bool vm_unlock_range (void *addr, size_t length);
+bool vm_pin_buffer (const void *buffer, size_t size, bool write,
+		struct vm_pin *pin);
+void vm_unpin_buffer (struct vm_pin *pin);
+bool vm_set_evict_policy (const char *name);
+void vm_set_pt_discard (bool discard);
+void vm_set_ksm_rate (size_t frames);
+bool vm_is_mapped (const void *addr);
 bool vm_try_handle_fault (struct intr_frame *f, void *addr, bool user,
 		bool write, bool not_present);
 
@@ -0,0 +1,75 @@
+#ifndef VM_VMA_H
+#define VM_VMA_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct file_region;
+
+/* How far below USER_STACK the stack may grow. */
+#define STACK_LIMIT (1 << 20)
+
+/* Fault-around window, in pages read after the faulting one. */
+#define FAULT_AROUND_INIT 2
+#define FAULT_AROUND_MAX 16
+
+enum vma_type {
+	VMA_EXEC,              /* A segment of the executable. */
+	VMA_STACK,             /* The user stack, grown on demand. */
+	VMA_MMAP,              /* A file mapping made by mmap (). */
+	VMA_SHARED,            /* Shared anonymous memory made by mmap (). */
+};
+
+/* Fault-around state of an area backed by a file region. It belongs to
+ * the process, not to the region, so that a parent and child that share
+ * the region after fork () each read ahead on their own pattern. BUFFER
+ * only lives until the fault that filled it has mapped its pages. */
+struct vma_readahead {
+	uint8_t *next_fault;   /* Where a sequential fault would hit. */
+	size_t window;         /* Most pages to read around a fault. */
+	uint8_t *ra_start;     /* Pages read ahead by the last fault. */
+	size_t ra_cnt;
+	uint8_t *buffer;       /* Data read for BUF_CNT pages at BUF_VA. */
+	uint8_t *buf_va;
+	size_t buf_cnt;
+	uint64_t buf_version;  /* inode_version () of the file when read. */
+};
+
+/* A virtual memory area: a run of pages of one process that were mapped
+ * together and are handled alike. Every page in the SPT lies in one, and
+ * an address outside all of them is invalid. */
+struct vma {
+	uint8_t *start;        /* First page. */
+	uint8_t *end;          /* Past the last page. */
+	enum vma_type type;
+	bool writable;
+	struct file_region *region; /* Backing file and offset, or NULL. The
+	                               area holds a reference on it. */
+	struct vma_readahead ra;    /* Used only if REGION is set. */
+
+	/* AVL tree links, ordered by START. */
+	struct vma *left, *right;
+	int height;
+};
+
+/* A process's areas, in a balanced binary search tree: finding the area
+ * that covers an address, and checking a range for overlap, take time
+ * logarithmic in the number of areas. Protected like the SPT it sits
+ * in. */
+struct vma_tree {
+	struct vma *root;
+	size_t cnt;
+};
+
+void vma_tree_init (struct vma_tree *tree);
+void vma_drop_buffer (struct vma *vma);
+bool vma_tree_copy (struct vma_tree *dst, const struct vma_tree *src);
+void vma_tree_destroy (struct vma_tree *tree);
+struct vma *vma_insert (struct vma_tree *tree, void *start, void *end,
+		enum vma_type type, bool writable, struct file_region *region);
+void vma_remove (struct vma_tree *tree, struct vma *vma);
+struct vma *vma_find (const struct vma_tree *tree, const void *addr);
+bool vma_overlaps (const struct vma_tree *tree, const void *start,
+		const void *end);
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Where the compressed tier keeps one page. */
+struct zswap_handle {
+	uint32_t block;        /* First block in the arena. */
+	uint32_t len;          /* Compressed size in bytes, 0 if not stored. */
+};
+
+void zswap_init (void);
+void zswap_set_size (size_t pages);
+bool zswap_store (const void *kva, struct zswap_handle *h);
+void zswap_load (const struct zswap_handle *h, void *kva);
+bool zswap_copy (const struct zswap_handle *src, struct zswap_handle *dst);
+void zswap_free (struct zswap_handle *h);
+void zswap_print_stats (void);
+
+#endif
@@ -155,6 +155,31 @@ munmap (void *addr) {
 	syscall1 (SYS_MUNMAP, addr);
 }
 
+int
+msync (void *addr, size_t length) {
+	return syscall2 (SYS_MSYNC, addr, length);
+}
+
+size_t
+set_rss_limit (size_t pages) {
+	return syscall1 (SYS_SET_RSS_LIMIT, pages);
+}
+
+int
+madvise (void *addr, size_t length, int advice) {
+	return syscall3 (SYS_MADVISE, addr, length, advice);
+}
+
+int
+mlock (const void *addr, size_t length) {
+	return syscall2 (SYS_MLOCK, addr, length);
+}
+
+int
+munlock (const void *addr, size_t length) {
+	return syscall2 (SYS_MUNLOCK, addr, length);
+}
+
 bool
 chdir (const char *dir) {
 	return syscall1 (SYS_CHDIR, dir);
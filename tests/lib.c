@@ -5,7 +5,7 @@
 #include <string.h>
 #include <syscall.h>
 
-const char *test_name;
+const char *test_name __attribute__ ((weak));
 bool quiet = false;
 
 static void
@@ -0,0 +1,27 @@
+/* Child process of page-text-share.
+   Run as "child-text 1", runs "child-text 0" and waits for it, so that
+   the second copy starts while the first still has its code in
+   memory. Either way exits with status 0 on success. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+
+const char *test_name = "child-text";
+
+int
+main (int argc, char *argv[])
+{
+  pid_t child;
+
+  if (argc < 2 || strcmp (argv[1], "1"))
+    return 0;
+
+  child = fork ("child-text");
+  if (child == 0)
+    {
+      exec ("child-text 0");
+      exit (1);
+    }
+  return wait (child);
+}
@@ -0,0 +1,101 @@
+/* Forks children that fill the same buffer with the same contents,
+   some of it all zeros, and blocks them on file reads so that the
+   page-merging daemon (enabled for this test with -ksm) can run.
+   Each child then checks the buffer, writes to every other page,
+   and checks the buffer again. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHILD_CNT 4
+#define PAGE_CNT 16
+#define PAGE_SIZE 4096
+
+static char buf[PAGE_CNT * PAGE_SIZE] __attribute__ ((aligned (4096)));
+
+/* The byte expected at the start of page P, after the child has
+   written to it if WRITTEN. Every fourth page is left all zeros. */
+static char
+expected (size_t p, bool written)
+{
+  if (written && p % 2 == 0)
+    return 'X';
+  return p % 4 == 0 ? 0 : 'a' + p;
+}
+
+static void
+fill (void)
+{
+  size_t p;
+
+  for (p = 0; p < PAGE_CNT; p++)
+    memset (buf + p * PAGE_SIZE, expected (p, false), PAGE_SIZE);
+}
+
+/* Reads sample.txt a few times, sleeping on the disk. */
+static void
+idle (void)
+{
+  char block[512];
+  int i;
+
+  for (i = 0; i < 8; i++)
+    {
+      int fd = open ("sample.txt");
+      if (fd < 2)
+        fail ("open \"sample.txt\"");
+      while (read (fd, block, sizeof block) > 0)
+        continue;
+      close (fd);
+    }
+}
+
+static void
+verify (bool written)
+{
+  size_t p, i;
+
+  for (p = 0; p < PAGE_CNT; p++)
+    for (i = 0; i < PAGE_SIZE; i++)
+      if (buf[p * PAGE_SIZE + i] != (i == 0 ? expected (p, written)
+                                     : expected (p, false)))
+        fail ("byte %zu of page %zu is wrong", i, p);
+}
+
+static void
+child (void)
+{
+  size_t p;
+
+  fill ();
+  idle ();
+  verify (false);
+  for (p = 0; p < PAGE_CNT; p += 2)
+    buf[p * PAGE_SIZE] = 'X';
+  idle ();
+  verify (true);
+  exit (0);
+}
+
+void
+test_main (void)
+{
+  pid_t children[CHILD_CNT];
+  size_t i;
+
+  fill ();
+  for (i = 0; i < CHILD_CNT; i++)
+    {
+      children[i] = fork ("child");
+      if (children[i] == 0)
+        child ();
+    }
+  for (i = 0; i < CHILD_CNT; i++)
+    if (wait (children[i]) != 0)
+      fail ("child %zu saw a corrupted buffer", i);
+  idle ();
+  verify (false);
+  msg ("buffers intact");
+}
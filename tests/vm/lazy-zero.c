@@ -0,0 +1,62 @@
+/* Reads all of a 16 MB array in BSS, which only fits in Pintos's
+   10 MB of memory and 4 MB of swap if the untouched pages share one
+   zero frame. Then writes some of the pages, and checks that they
+   hold what was written while the rest still read as zeros, also in a
+   forked child that writes pages of its own. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT (16 * 256)
+
+static char buf[PAGE_CNT * PAGE_SIZE];
+
+/* Checks that page P reads as zeros, or starts with BYTE and is zero
+   after that if BYTE is nonzero. */
+static void
+check_page (size_t p, char byte)
+{
+  size_t i;
+
+  if (buf[p * PAGE_SIZE] != byte)
+    fail ("page %zu starts with %d instead of %d",
+          p, buf[p * PAGE_SIZE], byte);
+  for (i = 1; i < PAGE_SIZE; i++)
+    if (buf[p * PAGE_SIZE + i] != 0)
+      fail ("byte %zu of page %zu is not zero", i, p);
+}
+
+void
+test_main (void)
+{
+  pid_t child;
+  size_t p;
+
+  msg ("read every page");
+  for (p = 0; p < PAGE_CNT; p++)
+    check_page (p, 0);
+
+  msg ("write every 64th page");
+  for (p = 0; p < PAGE_CNT; p += 64)
+    buf[p * PAGE_SIZE] = 'P';
+  for (p = 0; p < PAGE_CNT; p++)
+    check_page (p, p % 64 == 0 ? 'P' : 0);
+
+  child = fork ("child");
+  if (child == 0)
+    {
+      for (p = 32; p < PAGE_CNT; p += 64)
+        buf[p * PAGE_SIZE] = 'C';
+      for (p = 0; p < PAGE_CNT; p++)
+        check_page (p, p % 64 == 0 ? 'P' : p % 64 == 32 ? 'C' : 0);
+      exit (81);
+    }
+  CHECK (wait (child) == 81, "wait for child");
+
+  msg ("read every page again");
+  for (p = 0; p < PAGE_CNT; p++)
+    check_page (p, p % 64 == 0 ? 'P' : 0);
+}
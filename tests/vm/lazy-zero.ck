@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(lazy-zero) begin
+(lazy-zero) read every page
+(lazy-zero) write every 64th page
+(lazy-zero) wait for child
+(lazy-zero) read every page again
+(lazy-zero) end
+EOF
+pass;
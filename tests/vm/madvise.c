@@ -0,0 +1,48 @@
+/* Gives each kind of madvise advice for anonymous memory and a file
+   mapping, and checks what the pages hold afterwards. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_CNT 8
+#define ACTUAL ((void *) 0x10000000)
+
+static char buf[PAGE_CNT * 4096] __attribute__ ((aligned (4096)));
+
+void
+test_main (void)
+{
+  int handle;
+  size_t i;
+
+  memset (buf, 0xaa, sizeof buf);
+  CHECK (madvise (buf, sizeof buf, MADV_SEQUENTIAL) == 0,
+         "madvise SEQUENTIAL anonymous");
+  CHECK (madvise (buf, sizeof buf, MADV_DONTNEED) == 0,
+         "madvise DONTNEED anonymous");
+  for (i = 0; i < sizeof buf; i++)
+    if (buf[i] != 0)
+      fail ("byte %zu is %d after DONTNEED, not 0", i, buf[i]);
+  msg ("anonymous pages read back as zeros");
+
+  CHECK (create ("sample.txt", strlen (sample)), "create \"sample.txt\"");
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (mmap (ACTUAL, strlen (sample), 1, handle, 0) != MAP_FAILED,
+         "mmap \"sample.txt\"");
+  CHECK (madvise (ACTUAL, strlen (sample), MADV_WILLNEED) == 0,
+         "madvise WILLNEED file");
+  memcpy (ACTUAL, sample, strlen (sample));
+  CHECK (madvise (ACTUAL, strlen (sample), MADV_DONTNEED) == 0,
+         "madvise DONTNEED file");
+  CHECK (!memcmp (ACTUAL, sample, strlen (sample)),
+         "file pages read back as written");
+  CHECK (madvise (ACTUAL, strlen (sample), MADV_RANDOM) == 0,
+         "madvise RANDOM file");
+  CHECK (madvise ((char *) ACTUAL + 4096, 4096, MADV_WILLNEED) == -1,
+         "madvise past the mapping must fail");
+  munmap (ACTUAL);
+  close (handle);
+}
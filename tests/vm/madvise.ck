@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(madvise) begin
+(madvise) madvise SEQUENTIAL anonymous
+(madvise) madvise DONTNEED anonymous
+(madvise) anonymous pages read back as zeros
+(madvise) create "sample.txt"
+(madvise) open "sample.txt"
+(madvise) mmap "sample.txt"
+(madvise) madvise WILLNEED file
+(madvise) madvise DONTNEED file
+(madvise) file pages read back as written
+(madvise) madvise RANDOM file
+(madvise) madvise past the mapping must fail
+(madvise) end
+EOF
+pass;
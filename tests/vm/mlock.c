@@ -0,0 +1,35 @@
+/* Locks a buffer with mlock, pushes the rest of memory out to swap
+   by sweeping a larger array, and checks that the locked buffer
+   kept its contents, then unlocks it. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define LOCKED_SIZE (4 * 4096)
+#define SWEEP_SIZE (2 * 1024 * 1024)
+
+static char locked[LOCKED_SIZE] __attribute__ ((aligned (4096)));
+static char sweep[SWEEP_SIZE];
+
+void
+test_main (void)
+{
+  size_t i;
+
+  memset (locked, 0x5a, sizeof locked);
+  CHECK (mlock (locked, sizeof locked) == 0, "mlock buffer");
+  for (i = 0; i < sizeof sweep; i += 4096)
+    sweep[i] = i / 4096;
+  for (i = 0; i < sizeof sweep; i += 4096)
+    if (sweep[i] != (char) (i / 4096))
+      fail ("sweep page %zu is corrupted", i / 4096);
+  for (i = 0; i < sizeof locked; i++)
+    if (locked[i] != 0x5a)
+      fail ("locked byte %zu is %d, not %d", i, locked[i], 0x5a);
+  msg ("locked buffer intact");
+  CHECK (mlock ((void *) 0x10000000, 4096) == -1,
+         "mlock of unmapped memory must fail");
+  CHECK (munlock (locked, sizeof locked) == 0, "munlock buffer");
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mlock) begin
+(mlock) mlock buffer
+(mlock) locked buffer intact
+(mlock) mlock of unmapped memory must fail
+(mlock) munlock buffer
+(mlock) end
+EOF
+pass;
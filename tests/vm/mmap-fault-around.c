@@ -0,0 +1,36 @@
+/* Maps large.txt and reads it from start to end, checking each page
+   against read (). The faults run in sequence, so each should map the
+   pages after it too, with the window growing as they all get used;
+   the .ck checks that most pages were mapped that way. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define FILE_SIZE 2002990
+
+static char block[PAGE_SIZE];
+
+void
+test_main (void)
+{
+  char *map = (char *) 0x10000000;
+  size_t ofs;
+  int handle;
+
+  CHECK ((handle = open ("large.txt")) > 1, "open \"large.txt\"");
+  CHECK (mmap (map, FILE_SIZE, 0, handle, 0) != MAP_FAILED,
+         "mmap \"large.txt\"");
+  for (ofs = 0; ofs < FILE_SIZE; ofs += PAGE_SIZE)
+    {
+      size_t size = FILE_SIZE - ofs < PAGE_SIZE ? FILE_SIZE - ofs : PAGE_SIZE;
+      if (read (handle, block, size) != (int) size
+          || memcmp (map + ofs, block, size))
+        fail ("mapping differs from the file at offset %zu", ofs);
+    }
+  msg ("mapping reads back in order");
+  munmap (map);
+  close (handle);
+}
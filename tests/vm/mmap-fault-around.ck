@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::vm::stats;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-fault-around) begin
+(mmap-fault-around) open "large.txt"
+(mmap-fault-around) mmap "large.txt"
+(mmap-fault-around) mapping reads back in order
+(mmap-fault-around) end
+EOF
+my ($reads, $mapped) =
+  get_stats (qr/^Fault-around: (\d+) faults read ahead, (\d+) pages mapped/);
+fail "no fault mapped the pages after it\n" if $mapped == 0;
+fail "only $mapped of 490 pages mapped ahead in order\n" if $mapped < 245;
+pass;
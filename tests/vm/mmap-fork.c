@@ -0,0 +1,51 @@
+/* Writes to a file through a mapping and forks. The child maps the
+   same frames, so it sees the parent's writes before they reach the
+   file, and the parent sees the child's. After munmap() the file
+   holds both. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (2 * 4096)
+#define HALF (SIZE / 2)
+
+static char buf[SIZE];
+
+void
+test_main (void)
+{
+  char *map = (char *) 0x10000000;
+  int handle;
+  pid_t child;
+  size_t i;
+
+  CHECK (create ("data", SIZE), "create \"data\"");
+  CHECK ((handle = open ("data")) > 1, "open \"data\"");
+  CHECK (mmap (map, SIZE, 1, handle, 0) != MAP_FAILED, "mmap \"data\"");
+  memset (map, 'p', SIZE);
+
+  child = fork ("child");
+  if (child == 0)
+    {
+      for (i = 0; i < SIZE; i++)
+        if (map[i] != 'p')
+          exit (1);
+      memset (map + HALF, 'c', HALF);
+      exit (0);
+    }
+  CHECK (wait (child) == 0, "wait for child");
+
+  for (i = 0; i < SIZE; i++)
+    if (map[i] != (i < HALF ? 'p' : 'c'))
+      fail ("byte %zu is 0x%02x after the child wrote", i, map[i]);
+  msg ("parent sees the child's writes");
+  munmap (map);
+
+  CHECK (read (handle, buf, SIZE) == SIZE, "read \"data\"");
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != (i < HALF ? 'p' : 'c'))
+      fail ("byte %zu of the file is 0x%02x", i, buf[i]);
+  close (handle);
+}
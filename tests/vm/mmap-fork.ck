@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::vm::stats;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-fork) begin
+(mmap-fork) create "data"
+(mmap-fork) open "data"
+(mmap-fork) mmap "data"
+(mmap-fork) wait for child
+(mmap-fork) parent sees the child's writes
+(mmap-fork) read "data"
+(mmap-fork) end
+EOF
+my ($shared) = get_stats (qr/^Fork: \d+ swapped pages and (\d+) file pages/);
+fail "fork() did not share the mapped file's frames\n" if $shared == 0;
+pass;
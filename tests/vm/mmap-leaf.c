@@ -0,0 +1,34 @@
+/* Maps and unmaps one page of sample.txt 4,096 times, each time in a
+   2 MB region of its own, and reads it in between. Every mapping needs
+   a new leaf of the supplemental page table and a new page table, which
+   together take more memory than the kernel has, so this only succeeds
+   if unmapping the page frees both again. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define MAP_CNT 4096
+
+void
+test_main (void)
+{
+  int handle;
+  size_t i;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  for (i = 0; i < MAP_CNT; i++)
+    {
+      char *addr = (char *) 0x100000000 + i * 0x200000;
+
+      if (mmap (addr, 4096, 0, handle, 0) == MAP_FAILED)
+        fail ("mmap %zu", i);
+      if (memcmp (addr, sample, strlen (sample)))
+        fail ("mapping %zu reported bad data", i);
+      munmap (addr);
+    }
+  msg ("mapped and unmapped %d regions", MAP_CNT);
+  close (handle);
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-leaf) begin
+(mmap-leaf) open "sample.txt"
+(mmap-leaf) mapped and unmapped 4096 regions
+(mmap-leaf) end
+EOF
+pass;
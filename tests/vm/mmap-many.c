@@ -0,0 +1,73 @@
+/* Maps sample.txt 128 times, one page each, at addresses chosen in a
+   shuffled order with gaps between them, so that finding the area of
+   an address has many to choose from. Checks each mapping, unmaps
+   every other one, and checks that mmap () fails over the ones left
+   and succeeds in their freed places, and that a child touching an
+   unmapped page is killed. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define MAP_CNT 128
+
+static size_t order[MAP_CNT];
+
+/* Where mapping M starts. */
+static char *
+map_addr (size_t m)
+{
+  return (char *) 0x10000000 + m * 3 * 4096;
+}
+
+static void
+check_map (size_t m)
+{
+  if (memcmp (map_addr (m), sample, strlen (sample)))
+    fail ("mapping %zu reported bad data", m);
+}
+
+void
+test_main (void)
+{
+  int handle;
+  pid_t child;
+  size_t m;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  for (m = 0; m < MAP_CNT; m++)
+    order[m] = m;
+  shuffle (order, MAP_CNT, sizeof *order);
+  for (m = 0; m < MAP_CNT; m++)
+    if (mmap (map_addr (order[m]), 4096, 0, handle, 0) == MAP_FAILED)
+      fail ("mmap %zu", order[m]);
+  msg ("mapped \"sample.txt\" %d times", MAP_CNT);
+  for (m = 0; m < MAP_CNT; m++)
+    check_map (m);
+
+  for (m = 0; m < MAP_CNT; m += 2)
+    munmap (map_addr (m));
+  for (m = 1; m < MAP_CNT; m += 2)
+    {
+      check_map (m);
+      if (mmap (map_addr (m), 4096, 0, handle, 0) != MAP_FAILED)
+        fail ("mmap over mapping %zu succeeded", m);
+    }
+  msg ("unmapped every other mapping");
+
+  child = fork ("child");
+  if (child == 0)
+    exit (*map_addr (MAP_CNT / 2));
+  CHECK (wait (child) == -1, "child touching an unmapped page is killed");
+
+  for (m = 0; m < MAP_CNT; m += 2)
+    {
+      if (mmap (map_addr (m), 4096, 0, handle, 0) == MAP_FAILED)
+        fail ("mmap %zu again", m);
+      check_map (m);
+    }
+  msg ("mapped the freed places again");
+  close (handle);
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_USER_FAULTS => 1, IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-many) begin
+(mmap-many) open "sample.txt"
+(mmap-many) mapped "sample.txt" 128 times
+(mmap-many) unmapped every other mapping
+(mmap-many) child touching an unmapped page is killed
+(mmap-many) mapped the freed places again
+(mmap-many) end
+EOF
+pass;
@@ -0,0 +1,83 @@
+/* Maps the same part of a file privately twice, writes to some
+   pages of one mapping, and checks that neither the other mapping,
+   nor a forked child's writes, nor the file itself see it. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/large.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_CNT 4
+#define SIZE (PAGE_CNT * 4096)
+
+static char buf[4096];
+
+/* Checks that page I of MAP holds the file's data, or WRITTEN if
+   that page was written. */
+static bool
+page_ok (const char *map, size_t i, char written)
+{
+  const char *page = map + i * 4096;
+
+  if (written == 0)
+    return !memcmp (page, large + i * 4096, 4096);
+  for (size_t j = 0; j < 4096; j++)
+    if (page[j] != written)
+      return false;
+  return true;
+}
+
+void
+test_main (void)
+{
+  char *map = (char *) 0x10000000;
+  char *copy = (char *) 0x20000000;
+  int handle;
+  pid_t child;
+  size_t i;
+
+  CHECK ((handle = open ("large.txt")) > 1, "open \"large.txt\"");
+  CHECK (mmap (map, SIZE, 1 | MAP_PRIVATE, handle, 0) != MAP_FAILED,
+         "mmap \"large.txt\" privately");
+  CHECK (mmap (copy, SIZE, MAP_PRIVATE, handle, 0) != MAP_FAILED,
+         "mmap \"large.txt\" privately again");
+  for (i = 0; i < PAGE_CNT; i++)
+    if (!page_ok (map, i, 0) || !page_ok (copy, i, 0))
+      fail ("page %zu does not match the file", i);
+
+  /* Write every other page of the first mapping. */
+  for (i = 0; i < PAGE_CNT; i += 2)
+    memset (map + i * 4096, 'x', 4096);
+  for (i = 0; i < PAGE_CNT; i++)
+    if (!page_ok (map, i, i % 2 == 0 ? 'x' : 0) || !page_ok (copy, i, 0))
+      fail ("page %zu is wrong after the writes", i);
+  msg ("other mapping unchanged");
+
+  child = fork ("child");
+  if (child == 0)
+    {
+      for (i = 0; i < PAGE_CNT; i++)
+        if (!page_ok (map, i, i % 2 == 0 ? 'x' : 0))
+          exit (1);
+      memset (map, 'y', SIZE);
+      exit (0);
+    }
+  CHECK (wait (child) == 0, "wait for child");
+  for (i = 0; i < PAGE_CNT; i++)
+    if (!page_ok (map, i, i % 2 == 0 ? 'x' : 0))
+      fail ("page %zu changed by the child", i);
+  msg ("parent's mapping unchanged");
+
+  munmap (map);
+  munmap (copy);
+  for (i = 0; i < PAGE_CNT; i++)
+    {
+      if (read (handle, buf, sizeof buf) != (int) sizeof buf)
+        fail ("read of page %zu failed", i);
+      if (memcmp (buf, large + i * 4096, sizeof buf))
+        fail ("page %zu of the file changed", i);
+    }
+  msg ("file unchanged");
+  close (handle);
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-private) begin
+(mmap-private) open "large.txt"
+(mmap-private) mmap "large.txt" privately
+(mmap-private) mmap "large.txt" privately again
+(mmap-private) other mapping unchanged
+(mmap-private) wait for child
+(mmap-private) parent's mapping unchanged
+(mmap-private) file unchanged
+(mmap-private) end
+EOF
+pass;
@@ -0,0 +1,66 @@
+/* Maps large.txt so that the mapping starts just below a 2 MB boundary
+   and spans three page tables, and checks it against read () after
+   each operation on the whole range or part of it: dropping pages
+   across a boundary with madvise (DONTNEED), copying it in fork (), and
+   unmapping it, after which a child touching it must be killed. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define FILE_SIZE 2002990
+#define ACTUAL ((char *) 0x101f0000)
+#define BOUNDARY ((char *) 0x10200000)
+
+static char block[PAGE_SIZE];
+
+/* Compares the mapping at ACTUAL with the file. */
+static bool
+map_matches (int handle)
+{
+  size_t ofs;
+
+  seek (handle, 0);
+  for (ofs = 0; ofs < FILE_SIZE; ofs += PAGE_SIZE)
+    {
+      size_t size = FILE_SIZE - ofs < PAGE_SIZE ? FILE_SIZE - ofs : PAGE_SIZE;
+      if (read (handle, block, size) != (int) size
+          || memcmp (ACTUAL + ofs, block, size))
+        return false;
+    }
+  return true;
+}
+
+void
+test_main (void)
+{
+  int handle;
+  pid_t child;
+
+  CHECK ((handle = open ("large.txt")) > 1, "open \"large.txt\"");
+  CHECK (mmap (ACTUAL, FILE_SIZE, 0, handle, 0) != MAP_FAILED,
+         "mmap \"large.txt\"");
+  CHECK (map_matches (handle), "mapping matches the file");
+
+  CHECK (madvise (BOUNDARY - 4 * PAGE_SIZE, 8 * PAGE_SIZE,
+                  MADV_DONTNEED) == 0, "madvise DONTNEED across a boundary");
+  CHECK (map_matches (handle), "mapping matches the file");
+
+  child = fork ("child");
+  if (child == 0)
+    exit (map_matches (handle) ? 81 : -1);
+  CHECK (wait (child) == 81, "child's copy matches the file");
+
+  munmap (ACTUAL);
+  child = fork ("child");
+  if (child == 0)
+    exit (*BOUNDARY);
+  CHECK (wait (child) == -1, "child touching the unmapped range is killed");
+
+  CHECK (mmap (ACTUAL, FILE_SIZE, 0, handle, 0) != MAP_FAILED,
+         "mmap \"large.txt\" again");
+  CHECK (map_matches (handle), "mapping matches the file");
+  close (handle);
+}
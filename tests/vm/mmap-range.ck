@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_USER_FAULTS => 1, IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-range) begin
+(mmap-range) open "large.txt"
+(mmap-range) mmap "large.txt"
+(mmap-range) mapping matches the file
+(mmap-range) madvise DONTNEED across a boundary
+(mmap-range) mapping matches the file
+(mmap-range) child's copy matches the file
+(mmap-range) child touching the unmapped range is killed
+(mmap-range) mmap "large.txt" again
+(mmap-range) mapping matches the file
+(mmap-range) end
+EOF
+pass;
@@ -0,0 +1,47 @@
+/* Maps shared anonymous memory and forks a child, which checks what
+   the parent wrote and overwrites all of it, including pages neither
+   touched before the fork. The parent then sees the child's data. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_CNT 8
+#define SIZE (PAGE_CNT * 4096)
+#define HALF (SIZE / 2)
+
+void
+test_main (void)
+{
+  char *map = (char *) 0x10000000;
+  pid_t child;
+  size_t i;
+
+  CHECK (mmap (map, SIZE, 1 | MAP_ANONYMOUS, -1, 0) != MAP_FAILED,
+         "mmap shared memory");
+  for (i = 0; i < SIZE; i++)
+    if (map[i] != 0)
+      fail ("byte %zu of fresh shared memory is not zero", i);
+
+  /* Leave the second half alone until after the fork. */
+  for (i = 0; i < HALF; i += 4096)
+    memset (map + i, 'p', 4096);
+
+  child = fork ("child");
+  if (child == 0)
+    {
+      for (i = 0; i < HALF; i++)
+        if (map[i] != 'p')
+          exit (1);
+      memset (map, 'c', SIZE);
+      exit (0);
+    }
+  CHECK (wait (child) == 0, "wait for child");
+
+  for (i = 0; i < SIZE; i++)
+    if (map[i] != 'c')
+      fail ("byte %zu is 0x%02x, not the child's 'c'", i, map[i]);
+  msg ("parent sees the child's writes");
+  munmap (map);
+}
@@ -0,0 +1,77 @@
+/* Checks that no stale TLB entry survives a change to a mapping.
+   Maps sample.txt, reads it, unmaps it and maps zeros at the same
+   address, which must then read as zeros. Then writes to anonymous
+   pages, forks, and writes to them again at once in the parent: the
+   fork made them copy-on-write, so the child, which sleeps on the disk
+   first, must still see what was there before. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_CNT 16
+#define PAGE_SIZE 4096
+#define ACTUAL ((char *) 0x10000000)
+
+static char buf[PAGE_CNT * PAGE_SIZE] __attribute__ ((aligned (4096)));
+
+/* Reads sample.txt a few times, sleeping on the disk. */
+static void
+idle (void)
+{
+  char block[512];
+  int i;
+
+  for (i = 0; i < 8; i++)
+    {
+      int fd = open ("sample.txt");
+      if (fd < 2)
+        fail ("open \"sample.txt\"");
+      while (read (fd, block, sizeof block) > 0)
+        continue;
+      close (fd);
+    }
+}
+
+void
+test_main (void)
+{
+  int handle;
+  pid_t child;
+  size_t i;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (mmap (ACTUAL, strlen (sample), 0, handle, 0) != MAP_FAILED,
+         "mmap \"sample.txt\"");
+  if (memcmp (ACTUAL, sample, strlen (sample)))
+    fail ("read of mmap'd file reported bad data");
+  munmap (ACTUAL);
+  close (handle);
+
+  CHECK ((handle = open ("zeros")) > 1, "open \"zeros\"");
+  CHECK (mmap (ACTUAL, 4096, 0, handle, 0) != MAP_FAILED,
+         "mmap \"zeros\" at the same address");
+  for (i = 0; i < 4096; i++)
+    if (ACTUAL[i] != 0)
+      fail ("byte %zu of the new mapping is %d, not 0", i, ACTUAL[i]);
+  munmap (ACTUAL);
+  close (handle);
+
+  memset (buf, 'a', sizeof buf);
+  child = fork ("child");
+  if (child == 0)
+    {
+      idle ();
+      for (i = 0; i < sizeof buf; i++)
+        if (buf[i] != 'a')
+          exit (-1);
+      exit (81);
+    }
+  memset (buf, 'b', sizeof buf);
+  CHECK (wait (child) == 81, "child sees its own copy");
+  for (i = 0; i < sizeof buf; i++)
+    if (buf[i] != 'b')
+      fail ("byte %zu of the parent's copy is %d", i, buf[i]);
+}
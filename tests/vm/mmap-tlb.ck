@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-tlb) begin
+(mmap-tlb) open "sample.txt"
+(mmap-tlb) mmap "sample.txt"
+(mmap-tlb) open "zeros"
+(mmap-tlb) mmap "zeros" at the same address
+(mmap-tlb) child sees its own copy
+(mmap-tlb) end
+EOF
+pass;
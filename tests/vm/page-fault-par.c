@@ -0,0 +1,81 @@
+/* Forks children that fault at the same time: three map large.txt
+   and read it in different orders, comparing each page with read (),
+   while a fourth writes 8 MB of anonymous memory, with Pintos's memory
+   set to 10 MB, so that its faults wait on swap. No fault may see
+   another's half-loaded page, or wait for I/O it does not need. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHILD_CNT 4
+#define PAGE_SIZE 4096
+#define FILE_SIZE 2002990
+#define FILE_PAGES ((FILE_SIZE + PAGE_SIZE - 1) / PAGE_SIZE)
+#define ANON_PAGES (8 * 256)
+#define ACTUAL ((char *) 0x10000000)
+
+static char buf[ANON_PAGES * PAGE_SIZE] __attribute__ ((aligned (4096)));
+static char block[PAGE_SIZE];
+
+/* Maps large.txt and compares its pages with read (), visiting page
+   (I * STRIDE) % FILE_PAGES for each I. */
+static void
+map_child (size_t stride)
+{
+  int handle = open ("large.txt");
+  size_t i;
+
+  if (handle < 2 || mmap (ACTUAL, FILE_SIZE, 0, handle, 0) == MAP_FAILED)
+    exit (-1);
+  for (i = 0; i < FILE_PAGES; i++)
+    {
+      size_t ofs = (i * stride) % FILE_PAGES * PAGE_SIZE;
+      size_t size = FILE_SIZE - ofs < PAGE_SIZE ? FILE_SIZE - ofs : PAGE_SIZE;
+
+      seek (handle, ofs);
+      if (read (handle, block, size) != (int) size
+          || memcmp (ACTUAL + ofs, block, size))
+        exit (-1);
+    }
+  exit (0);
+}
+
+static void
+anon_child (void)
+{
+  size_t p, i;
+
+  for (p = 0; p < ANON_PAGES; p++)
+    for (i = 0; i < PAGE_SIZE; i += 128)
+      buf[p * PAGE_SIZE + i] = p + i;
+  for (p = 0; p < ANON_PAGES; p++)
+    for (i = 0; i < PAGE_SIZE; i += 128)
+      if (buf[p * PAGE_SIZE + i] != (char) (p + i))
+        exit (-1);
+  exit (0);
+}
+
+void
+test_main (void)
+{
+  static const size_t strides[CHILD_CNT - 1] = {1, FILE_PAGES - 1, 97};
+  pid_t children[CHILD_CNT];
+  size_t c;
+
+  for (c = 0; c < CHILD_CNT; c++)
+    {
+      children[c] = fork ("child");
+      if (children[c] == 0)
+        {
+          if (c < CHILD_CNT - 1)
+            map_child (strides[c]);
+          anon_child ();
+        }
+    }
+  for (c = 0; c < CHILD_CNT; c++)
+    if (wait (children[c]) != 0)
+      fail ("child %zu saw a wrong page", c);
+  msg ("all children done");
+}
@@ -0,0 +1,94 @@
+/* Fills a 2 MB block of BSS aligned so that it can be backed by one
+   huge page, then uses up the kernel's memory with small anonymous
+   mappings, each in a 2 MB region of its own and then next to the
+   others, before dropping a few pages in the middle of the block with
+   madvise (DONTNEED). That must split the huge page even though no
+   kernel page is left for its page table, and the dropped pages must
+   read back as zeros while the rest keep their contents. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define BLOCK_SIZE (2 * 1024 * 1024)
+#define PAGE_CNT (BLOCK_SIZE / PAGE_SIZE)
+#define DROP_FIRST 100
+#define DROP_CNT 10
+
+/* The mappings that use up kernel memory go here, one per region
+   first and then filling the regions. */
+#define FILL_BASE ((char *) 0x100000000)
+#define FILL_MAX 8192
+
+static char buf[BLOCK_SIZE] __attribute__ ((aligned (BLOCK_SIZE)));
+static char *fill[FILL_MAX * 4];
+static size_t fill_cnt;
+
+/* The byte expected at offset I of page P, with DROPPED pages
+   dropped. */
+static char
+expected (size_t p, size_t i, bool dropped)
+{
+  if (dropped && p >= DROP_FIRST && p < DROP_FIRST + DROP_CNT)
+    return 0;
+  return p + i / 32 + 1;
+}
+
+static void
+check (bool dropped)
+{
+  size_t p, i;
+
+  for (p = 0; p < PAGE_CNT; p++)
+    for (i = 0; i < PAGE_SIZE; i++)
+      if (buf[p * PAGE_SIZE + i] != expected (p, i, dropped))
+        fail ("byte %zu of page %zu is wrong", i, p);
+}
+
+/* Maps one page at ADDR, if memory allows. */
+static bool
+fill_page (char *addr)
+{
+  if (fill_cnt >= sizeof fill / sizeof *fill
+      || mmap (addr, PAGE_SIZE, 1 | MAP_ANONYMOUS, -1, 0) == MAP_FAILED)
+    return false;
+  fill[fill_cnt++] = addr;
+  return true;
+}
+
+void
+test_main (void)
+{
+  size_t p, i, region_cnt;
+
+  msg ("fill block");
+  for (p = 0; p < PAGE_CNT; p++)
+    for (i = 0; i < PAGE_SIZE; i++)
+      buf[p * PAGE_SIZE + i] = expected (p, i, false);
+  check (false);
+
+  /* A mapping in a region of its own costs the kernel a whole page.
+     Once those run out, mappings next to the first ones use up what
+     is left in the kernel's partly used pages. */
+  for (region_cnt = 0; region_cnt < FILL_MAX; region_cnt++)
+    if (!fill_page (FILL_BASE + region_cnt * BLOCK_SIZE))
+      break;
+  for (p = 1; p < PAGE_CNT; p++)
+    for (i = 0; i < region_cnt; i++)
+      if (!fill_page (FILL_BASE + i * BLOCK_SIZE + p * PAGE_SIZE))
+        goto full;
+full:
+  if (region_cnt == FILL_MAX)
+    fail ("kernel memory did not run out");
+
+  CHECK (madvise (buf + DROP_FIRST * PAGE_SIZE, DROP_CNT * PAGE_SIZE,
+                  MADV_DONTNEED) == 0, "madvise DONTNEED inside the block");
+  check (true);
+
+  for (i = 0; i < fill_cnt; i++)
+    munmap (fill[i]);
+  msg ("check block");
+  check (true);
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-huge-oom) begin
+(page-huge-oom) fill block
+(page-huge-oom) madvise DONTNEED inside the block
+(page-huge-oom) check block
+(page-huge-oom) end
+EOF
+pass;
@@ -0,0 +1,72 @@
+/* Writes every page of two 2 MB blocks of BSS that are aligned so that
+   each can be backed by one huge page, and checks them. Then drops a
+   few pages in the middle of the first block with madvise (DONTNEED),
+   which must split it, and writes to pages of the second one in a
+   forked child, which must copy them on write without touching the
+   parent's. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define BLOCK_SIZE (2 * 1024 * 1024)
+#define PAGE_CNT (2 * BLOCK_SIZE / PAGE_SIZE)
+#define DROP_FIRST 100
+#define DROP_CNT 10
+
+static char buf[2 * BLOCK_SIZE] __attribute__ ((aligned (BLOCK_SIZE)));
+
+/* The byte expected at offset I of page P, with DROPPED pages dropped
+   and in the child if CHILD. */
+static char
+expected (size_t p, size_t i, bool dropped, bool child)
+{
+  if (dropped && p >= DROP_FIRST && p < DROP_FIRST + DROP_CNT)
+    return 0;
+  if (child && p >= PAGE_CNT / 2 && p % 16 == 0 && i == 0)
+    return 'C';
+  return p + i / 32 + 1;
+}
+
+static void
+check (bool dropped, bool child)
+{
+  size_t p, i;
+
+  for (p = 0; p < PAGE_CNT; p++)
+    for (i = 0; i < PAGE_SIZE; i++)
+      if (buf[p * PAGE_SIZE + i] != expected (p, i, dropped, child))
+        fail ("byte %zu of page %zu is wrong", i, p);
+}
+
+void
+test_main (void)
+{
+  pid_t child;
+  size_t p, i;
+
+  msg ("fill blocks");
+  for (p = 0; p < PAGE_CNT; p++)
+    for (i = 0; i < PAGE_SIZE; i++)
+      buf[p * PAGE_SIZE + i] = expected (p, i, false, false);
+  check (false, false);
+
+  CHECK (madvise (buf + DROP_FIRST * PAGE_SIZE, DROP_CNT * PAGE_SIZE,
+                  MADV_DONTNEED) == 0, "madvise DONTNEED inside a block");
+  check (true, false);
+
+  child = fork ("child");
+  if (child == 0)
+    {
+      for (p = PAGE_CNT / 2; p < PAGE_CNT; p += 16)
+        buf[p * PAGE_SIZE] = 'C';
+      check (true, true);
+      exit (81);
+    }
+  CHECK (wait (child) == 81, "wait for child");
+
+  msg ("check blocks");
+  check (true, false);
+}
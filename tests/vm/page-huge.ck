@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-huge) begin
+(page-huge) fill blocks
+(page-huge) madvise DONTNEED inside a block
+(page-huge) wait for child
+(page-huge) check blocks
+(page-huge) end
+EOF
+pass;
@@ -0,0 +1,60 @@
+/* Fills 24 MB of memory, with Pintos's memory set to 37 MB so that
+   the kernel's direct map of it ends in a partial large page, and
+   checks it. A forked child then checks it too and writes to every
+   page, which makes the kernel copy each one through the direct map,
+   while the parent waits and checks that its own copy is unchanged. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT (24 * 256)
+
+static char buf[PAGE_CNT * PAGE_SIZE];
+
+/* The byte expected at offset I of page P, in the child if CHILD. */
+static char
+expected (size_t p, size_t i, bool child)
+{
+  return (p * 3 + i / 512) ^ (child && i == 0 ? 0x55 : 0);
+}
+
+static void
+check (bool child)
+{
+  size_t p, i;
+
+  for (p = 0; p < PAGE_CNT; p++)
+    for (i = 0; i < PAGE_SIZE; i += 8)
+      if (buf[p * PAGE_SIZE + i] != expected (p, i, child))
+        fail ("byte %zu of page %zu is wrong", i, p);
+}
+
+void
+test_main (void)
+{
+  pid_t child;
+  size_t p, i;
+
+  msg ("fill memory");
+  for (p = 0; p < PAGE_CNT; p++)
+    for (i = 0; i < PAGE_SIZE; i += 8)
+      buf[p * PAGE_SIZE + i] = expected (p, i, false);
+  check (false);
+
+  child = fork ("child");
+  if (child == 0)
+    {
+      check (false);
+      for (p = 0; p < PAGE_CNT; p++)
+        buf[p * PAGE_SIZE] = expected (p, 0, true);
+      check (true);
+      exit (81);
+    }
+  CHECK (wait (child) == 81, "wait for child");
+
+  msg ("check memory");
+  check (false);
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-kmap) begin
+(page-kmap) fill memory
+(page-kmap) wait for child
+(page-kmap) check memory
+(page-kmap) end
+EOF
+pass;
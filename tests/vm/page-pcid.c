@@ -0,0 +1,82 @@
+/* Forks waves of children that each fill the same virtual pages with
+   a byte of their own, then keep checking them while they sleep on the
+   disk, so that the CPU switches among their address spaces many
+   times. Children of later waves may get the address-space tags of
+   ones that exited. No process may see another's pages. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define WAVE_CNT 3
+#define CHILD_CNT 4
+#define PAGE_CNT 16
+#define PAGE_SIZE 4096
+
+static char buf[PAGE_CNT * PAGE_SIZE] __attribute__ ((aligned (4096)));
+
+/* Reads sample.txt, sleeping on the disk. */
+static void
+idle (void)
+{
+  char block[512];
+  int fd = open ("sample.txt");
+
+  if (fd < 2)
+    exit (-1);
+  while (read (fd, block, sizeof block) > 0)
+    continue;
+  close (fd);
+}
+
+static bool
+holds (char byte)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof buf; i++)
+    if (buf[i] != byte)
+      return false;
+  return true;
+}
+
+static void
+child (char byte)
+{
+  int round;
+
+  memset (buf, byte, sizeof buf);
+  for (round = 0; round < 8; round++)
+    {
+      idle ();
+      if (!holds (byte))
+        exit (-1);
+    }
+  exit (byte);
+}
+
+void
+test_main (void)
+{
+  pid_t children[CHILD_CNT];
+  int wave;
+  size_t c;
+
+  memset (buf, 'P', sizeof buf);
+  for (wave = 0; wave < WAVE_CNT; wave++)
+    {
+      for (c = 0; c < CHILD_CNT; c++)
+        {
+          children[c] = fork ("child");
+          if (children[c] == 0)
+            child ('a' + wave * CHILD_CNT + c);
+        }
+      for (c = 0; c < CHILD_CNT; c++)
+        if (wait (children[c]) != (int) ('a' + wave * CHILD_CNT + c))
+          fail ("child %zu of wave %d saw another's pages", c, wave);
+      if (!holds ('P'))
+        fail ("parent's pages changed in wave %d", wave);
+      msg ("wave %d done", wave);
+    }
+}
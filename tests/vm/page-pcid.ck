@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-pcid) begin
+(page-pcid) wave 0 done
+(page-pcid) wave 1 done
+(page-pcid) wave 2 done
+(page-pcid) end
+EOF
+pass;
@@ -0,0 +1,60 @@
+/* Forks children that each write 4 MB of memory at the same time, 16 MB
+   in all with Pintos's memory set to 10 MB, so that faults keep
+   dipping below the free-frame watermarks and the reclaim thread
+   runs alongside them. Child I goes over its memory I + 1 times,
+   so the children exit, and free their frames, while the rest are
+   still under pressure. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHILD_CNT 4
+#define PAGE_SIZE 4096
+#define PAGE_CNT (4 * 256)
+
+static char buf[PAGE_CNT * PAGE_SIZE] __attribute__ ((aligned (4096)));
+
+/* The byte expected at offset I of page P of child C in round R. */
+static char
+expected (size_t c, size_t r, size_t p, size_t i)
+{
+  return c * 61 + r * 17 + p + i / 512;
+}
+
+static void
+child (size_t c)
+{
+  size_t r, p, i;
+
+  for (r = 0; r <= c; r++)
+    {
+      for (p = 0; p < PAGE_CNT; p++)
+        for (i = 0; i < PAGE_SIZE; i += 64)
+          buf[p * PAGE_SIZE + i] = expected (c, r, p, i);
+      for (p = 0; p < PAGE_CNT; p++)
+        for (i = 0; i < PAGE_SIZE; i += 64)
+          if (buf[p * PAGE_SIZE + i] != expected (c, r, p, i))
+            exit (-1);
+    }
+  exit (c);
+}
+
+void
+test_main (void)
+{
+  pid_t children[CHILD_CNT];
+  size_t c;
+
+  for (c = 0; c < CHILD_CNT; c++)
+    {
+      children[c] = fork ("child");
+      if (children[c] == 0)
+        child (c);
+    }
+  for (c = 0; c < CHILD_CNT; c++)
+    if (wait (children[c]) != (int) c)
+      fail ("child %zu saw a corrupted page", c);
+  msg ("all children done");
+}
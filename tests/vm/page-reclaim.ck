@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::vm::stats;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-reclaim) begin
+(page-reclaim) all children done
+(page-reclaim) end
+EOF
+my ($freed) = get_stats (qr/^Reclaim: (\d+) frames freed in the background/);
+fail "reclaimd freed no frame\n" if $freed == 0;
+pass;
@@ -0,0 +1,22 @@
+/* Runs child-text, which runs a second copy of itself while it is
+   still alive. The second copy finds the code pages of the first in
+   the text page cache, which the .ck checks through the kernel's
+   statistics. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  pid_t child;
+
+  child = fork ("child-text");
+  if (child == 0)
+    {
+      exec ("child-text 1");
+      exit (1);
+    }
+  CHECK (wait (child) == 0, "wait for child-text");
+}
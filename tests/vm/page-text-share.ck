@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::vm::stats;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-text-share) begin
+(page-text-share) wait for child-text
+(page-text-share) end
+EOF
+my ($shared) = get_stats (qr/^Text pages: \d+ loaded, (\d+) shared/);
+fail "no text page was found in the page cache\n" if $shared == 0;
+pass;
@@ -0,0 +1,31 @@
+/* Limits the process to a few resident pages, then fills and
+   verifies 1 MB of memory, so that it has to evict its own
+   pages to keep within the limit. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (1024 * 1024)
+#define LIMIT 32
+
+static char buf[SIZE];
+
+void
+test_main (void)
+{
+  size_t i;
+
+  set_rss_limit (LIMIT);
+  msg ("limit set");
+
+  for (i = 0; i < SIZE; i++)
+    buf[i] = i * 7;
+  msg ("write pass");
+
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != (char) (i * 7))
+      fail ("byte %zu is wrong", i);
+  msg ("read pass");
+}
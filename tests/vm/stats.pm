@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+# Returns the numbers that REGEX captures from the line of statistics
+# the kernel printed as it powered off, failing if there is no such line.
+sub get_stats {
+    my ($regex) = @_;
+    our ($test);
+    my (@output) = read_text_file ("$test.output");
+    my ($line) = grep (/$regex/, @output);
+
+    fail "Run didn't print statistics matching /$regex/\n"
+      if !defined $line;
+    return $line =~ /$regex/;
+}
+
+1;
@@ -0,0 +1,70 @@
+/* Fills 12 MB of anonymous memory in order, more than fits in Pintos's
+   10 MB, so that eviction writes runs of neighbouring pages to swap
+   together. Reads it back in a shuffled order with swap readahead off
+   (-swap-ra=0 for this test), so that each page comes back from its own
+   slot of a cluster. Then rewrites every third page, which frees and
+   reuses slots in the middle of clusters, and checks everything again. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT (12 * 256)
+
+static char buf[PAGE_CNT * PAGE_SIZE] __attribute__ ((aligned (4096)));
+static size_t order[PAGE_CNT];
+
+/* The byte expected at offset I of page P, after REWRITTEN. */
+static char
+expected (size_t p, size_t i, bool rewritten)
+{
+  if (rewritten && p % 3 == 0)
+    return ~(p + i / 128);
+  return p + i / 128;
+}
+
+static void
+fill_page (size_t p, bool rewritten)
+{
+  size_t i;
+
+  for (i = 0; i < PAGE_SIZE; i++)
+    buf[p * PAGE_SIZE + i] = expected (p, i, rewritten);
+}
+
+static void
+check_page (size_t p, bool rewritten)
+{
+  size_t i;
+
+  for (i = 0; i < PAGE_SIZE; i++)
+    if (buf[p * PAGE_SIZE + i] != expected (p, i, rewritten))
+      fail ("byte %zu of page %zu is wrong", i, p);
+}
+
+void
+test_main (void)
+{
+  size_t p;
+
+  msg ("fill memory");
+  for (p = 0; p < PAGE_CNT; p++)
+    fill_page (p, false);
+
+  msg ("check in shuffled order");
+  for (p = 0; p < PAGE_CNT; p++)
+    order[p] = p;
+  shuffle (order, PAGE_CNT, sizeof *order);
+  for (p = 0; p < PAGE_CNT; p++)
+    check_page (order[p], false);
+
+  msg ("rewrite every third page");
+  for (p = 0; p < PAGE_CNT; p += 3)
+    fill_page (p, true);
+
+  msg ("check in order");
+  for (p = 0; p < PAGE_CNT; p++)
+    check_page (p, true);
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::vm::stats;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(swap-cluster) begin
+(swap-cluster) fill memory
+(swap-cluster) check in shuffled order
+(swap-cluster) rewrite every third page
+(swap-cluster) check in order
+(swap-cluster) end
+EOF
+my ($pages, $writes) = get_stats (qr/^Swap out: (\d+) pages in (\d+) writes/);
+fail "no page was swapped out\n" if $pages == 0;
+fail "$pages pages swapped out in $writes writes: no cluster was written "
+  . "at once\n" if $writes >= $pages;
+pass;
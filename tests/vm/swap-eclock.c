@@ -0,0 +1,84 @@
+/* Maps large.txt and fills 12 MB of anonymous memory, more than fits
+   in Pintos's 10 MB, so that the enhanced clock policy (selected for
+   this test with -evict=eclock) has to choose between clean file pages
+   and dirty anonymous ones. A small set of hot pages is rewritten
+   after every chunk to keep it referenced. Then checks every byte of
+   the anonymous memory and compares the mapping with read (). */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT (12 * 256)
+#define HOT_CNT 8
+#define ACTUAL ((char *) 0x10000000)
+#define FILE_SIZE 2002990
+
+static char buf[PAGE_CNT * PAGE_SIZE] __attribute__ ((aligned (4096)));
+static char block[PAGE_SIZE];
+
+/* The byte expected at offset I of page P. */
+static char
+expected (size_t p, size_t i)
+{
+  return p * 7 + i / 64;
+}
+
+static void
+fill_page (size_t p)
+{
+  size_t i;
+
+  for (i = 0; i < PAGE_SIZE; i++)
+    buf[p * PAGE_SIZE + i] = expected (p, i);
+}
+
+/* Compares the whole mapping with the file, one page at a time. */
+static void
+check_map (int handle)
+{
+  size_t ofs;
+
+  seek (handle, 0);
+  for (ofs = 0; ofs < FILE_SIZE; ofs += PAGE_SIZE)
+    {
+      size_t size = FILE_SIZE - ofs < PAGE_SIZE ? FILE_SIZE - ofs : PAGE_SIZE;
+      if (read (handle, block, size) != (int) size)
+        fail ("read \"large.txt\" at offset %zu", ofs);
+      if (memcmp (ACTUAL + ofs, block, size))
+        fail ("mapping differs from the file at offset %zu", ofs);
+    }
+}
+
+void
+test_main (void)
+{
+  size_t p, i;
+  int handle;
+
+  CHECK ((handle = open ("large.txt")) > 1, "open \"large.txt\"");
+  CHECK (mmap (ACTUAL, FILE_SIZE, 0, handle, 0) != MAP_FAILED,
+         "mmap \"large.txt\"");
+  check_map (handle);
+
+  msg ("fill memory");
+  for (p = 0; p < PAGE_CNT; p++)
+    {
+      fill_page (p);
+      if (p % 64 == 0)
+        for (i = 0; i < HOT_CNT; i++)
+          fill_page (i);
+    }
+
+  msg ("check memory");
+  for (p = 0; p < PAGE_CNT; p++)
+    for (i = 0; i < PAGE_SIZE; i++)
+      if (buf[p * PAGE_SIZE + i] != expected (p, i))
+        fail ("byte %zu of page %zu is wrong", i, p);
+
+  msg ("check mapping");
+  check_map (handle);
+  close (handle);
+}
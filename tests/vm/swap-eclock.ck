@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(swap-eclock) begin
+(swap-eclock) open "large.txt"
+(swap-eclock) mmap "large.txt"
+(swap-eclock) fill memory
+(swap-eclock) check memory
+(swap-eclock) check mapping
+(swap-eclock) end
+EOF
+pass;
@@ -0,0 +1,67 @@
+/* Fills 12 MB of anonymous memory, more than fits in Pintos's 10 MB,
+   so that most of it is swapped out, and forks. The child shares the
+   parent's swap space instead of having fork() read every swapped-out
+   page back in; the .ck checks that swap-in stayed rare. Both sides
+   then check a few pages at each end, and the child rewrites them,
+   which must not show through in the parent. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT (12 * 256)
+#define CHECK_CNT 8
+
+static char buf[PAGE_CNT * PAGE_SIZE] __attribute__ ((aligned (4096)));
+
+/* Checks that page P holds byte VALUE throughout, or exits with
+   status 1 if not. */
+static void
+check_page (size_t p, char value)
+{
+  size_t i;
+
+  for (i = 0; i < PAGE_SIZE; i++)
+    if (buf[p * PAGE_SIZE + i] != value)
+      exit (1);
+}
+
+/* Checks the first and the last CHECK_CNT pages, which should hold
+   their page number. */
+static void
+check_ends (void)
+{
+  size_t i;
+
+  for (i = 0; i < CHECK_CNT; i++)
+    {
+      check_page (i, i);
+      check_page (PAGE_CNT - 1 - i, PAGE_CNT - 1 - i);
+    }
+}
+
+void
+test_main (void)
+{
+  pid_t child;
+  size_t p;
+
+  msg ("fill memory");
+  for (p = 0; p < PAGE_CNT; p++)
+    memset (buf + p * PAGE_SIZE, p, PAGE_SIZE);
+
+  child = fork ("child");
+  if (child == 0)
+    {
+      check_ends ();
+      for (p = 0; p < CHECK_CNT; p++)
+        memset (buf + p * PAGE_SIZE, 0xcc, PAGE_SIZE);
+      exit (0);
+    }
+  CHECK (wait (child) == 0, "wait for child");
+
+  check_ends ();
+  msg ("parent's pages are intact");
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::vm::stats;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(swap-fork-lazy) begin
+(swap-fork-lazy) fill memory
+(swap-fork-lazy) wait for child
+(swap-fork-lazy) parent's pages are intact
+(swap-fork-lazy) end
+EOF
+my ($shared) = get_stats (qr/^Fork: (\d+) swapped pages/);
+fail "fork() shared no swapped-out page with the child\n" if $shared == 0;
+my ($hits, $misses) = get_stats (qr/^Swap: (\d+) cache hits, (\d+) misses/);
+fail "$hits + $misses pages swapped in: fork() read swapped pages back\n"
+  if $hits + $misses >= 256;
+pass;
@@ -0,0 +1,79 @@
+/* Maps large.txt three times, each in page tables of its own, and
+   reads the mappings. Then fills 10 MB of anonymous memory, with
+   Pintos's memory set to 10 MB, which evicts the mapped pages, so that
+   their page tables, left empty, are freed (-pt-discard for this
+   test). The mappings must still read back right, also after one of
+   them is unmapped and mapped again, and so must the memory. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT (10 * 256)
+#define MAP_CNT 3
+#define FILE_SIZE 2002990
+
+static char buf[PAGE_CNT * PAGE_SIZE] __attribute__ ((aligned (4096)));
+static char block[PAGE_SIZE];
+
+/* Where mapping M starts. */
+static char *
+map_addr (int m)
+{
+  return (char *) 0x10000000 + m * 0x400000;
+}
+
+/* Compares mapping M with the file. */
+static void
+check_map (int handle, int m)
+{
+  size_t ofs;
+
+  seek (handle, 0);
+  for (ofs = 0; ofs < FILE_SIZE; ofs += PAGE_SIZE)
+    {
+      size_t size = FILE_SIZE - ofs < PAGE_SIZE ? FILE_SIZE - ofs : PAGE_SIZE;
+      if (read (handle, block, size) != (int) size
+          || memcmp (map_addr (m) + ofs, block, size))
+        fail ("mapping %d differs from the file at offset %zu", m, ofs);
+    }
+}
+
+void
+test_main (void)
+{
+  int handle;
+  size_t p;
+  int m;
+
+  CHECK ((handle = open ("large.txt")) > 1, "open \"large.txt\"");
+  for (m = 0; m < MAP_CNT; m++)
+    {
+      if (mmap (map_addr (m), FILE_SIZE, 0, handle, 0) == MAP_FAILED)
+        fail ("mmap \"large.txt\" %d", m);
+      check_map (handle, m);
+    }
+  msg ("mapped \"large.txt\" %d times", MAP_CNT);
+
+  msg ("fill memory");
+  for (p = 0; p < PAGE_CNT; p++)
+    memset (buf + p * PAGE_SIZE, p, PAGE_SIZE);
+
+  for (m = 0; m < MAP_CNT; m++)
+    check_map (handle, m);
+  msg ("mappings read back");
+
+  munmap (map_addr (1));
+  CHECK (mmap (map_addr (1), FILE_SIZE, 0, handle, 0) != MAP_FAILED,
+         "mmap \"large.txt\" again");
+  check_map (handle, 1);
+
+  for (p = 0; p < PAGE_CNT; p++)
+    if (buf[p * PAGE_SIZE] != (char) p
+        || buf[p * PAGE_SIZE + PAGE_SIZE - 1] != (char) p)
+      fail ("page %zu is wrong", p);
+  msg ("memory reads back");
+  close (handle);
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::vm::stats;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(swap-pt-discard) begin
+(swap-pt-discard) open "large.txt"
+(swap-pt-discard) mapped "large.txt" 3 times
+(swap-pt-discard) fill memory
+(swap-pt-discard) mappings read back
+(swap-pt-discard) mmap "large.txt" again
+(swap-pt-discard) memory reads back
+(swap-pt-discard) end
+EOF
+my ($discarded) = get_stats (qr/^Page tables: (\d+) discarded/);
+fail "no page table was discarded\n" if $discarded == 0;
+pass;
@@ -0,0 +1,68 @@
+/* Fills 12 MB of anonymous memory, more than fits in Pintos's 10 MB,
+   and reads it back in order with swap readahead widened to 16 pages
+   (-swap-ra=16 for this test), so that most pages are already in
+   memory when they are touched. Each page is rewritten right after
+   it is checked, so the pages read ahead must not be swapped back in
+   from stale slots later. Finally checks the new contents backward,
+   against the direction of readahead, and then forward. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT (12 * 256)
+
+static char buf[PAGE_CNT * PAGE_SIZE] __attribute__ ((aligned (4096)));
+
+/* The byte expected at offset I of page P in pass PASS. */
+static char
+expected (size_t p, size_t i, int pass)
+{
+  return (p + i / 256) * (pass + 1) + pass;
+}
+
+static void
+fill_page (size_t p, int pass)
+{
+  size_t i;
+
+  for (i = 0; i < PAGE_SIZE; i++)
+    buf[p * PAGE_SIZE + i] = expected (p, i, pass);
+}
+
+static void
+check_page (size_t p, int pass)
+{
+  size_t i;
+
+  for (i = 0; i < PAGE_SIZE; i++)
+    if (buf[p * PAGE_SIZE + i] != expected (p, i, pass))
+      fail ("byte %zu of page %zu is wrong in pass %d", i, p, pass);
+}
+
+void
+test_main (void)
+{
+  size_t p;
+
+  msg ("fill memory");
+  for (p = 0; p < PAGE_CNT; p++)
+    fill_page (p, 0);
+
+  msg ("check and rewrite in order");
+  for (p = 0; p < PAGE_CNT; p++)
+    {
+      check_page (p, 0);
+      fill_page (p, 1);
+    }
+
+  msg ("check backward");
+  for (p = PAGE_CNT; p-- > 0; )
+    check_page (p, 1);
+
+  msg ("check forward");
+  for (p = 0; p < PAGE_CNT; p++)
+    check_page (p, 1);
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::vm::stats;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(swap-ra) begin
+(swap-ra) fill memory
+(swap-ra) check and rewrite in order
+(swap-ra) check backward
+(swap-ra) check forward
+(swap-ra) end
+EOF
+my ($hits, $misses, $ahead) =
+  get_stats (qr/^Swap: (\d+) cache hits, (\d+) misses, (\d+) pages read ahead/);
+fail "no page was read ahead\n" if $ahead == 0;
+fail "no fault was served from the swap cache\n" if $hits == 0;
+pass;
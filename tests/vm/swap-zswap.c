@@ -0,0 +1,74 @@
+/* Fills 12 MB of anonymous memory, more than fits in Pintos's 10 MB,
+   with compressed swap enabled (-zswap=512 for this test) in front of
+   the swap disk. Even pages hold short runs of bytes that compress
+   well; odd pages hold an RC4 key stream, which does not compress and
+   so goes to the disk. The compressed tier fills up, too. Checks every
+   page, rewrites every even page with new runs, and checks again. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/arc4.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT (12 * 256)
+
+static char buf[PAGE_CNT * PAGE_SIZE] __attribute__ ((aligned (4096)));
+static char page[PAGE_SIZE];
+
+/* Puts the contents expected of page P in pass PASS into PAGE. */
+static void
+expected (size_t p, int pass)
+{
+  if (p % 2 == 0)
+    {
+      size_t i;
+
+      for (i = 0; i < PAGE_SIZE; i++)
+        page[i] = p + pass + i / 256;
+    }
+  else
+    {
+      struct arc4 arc4;
+
+      memset (page, 0, PAGE_SIZE);
+      arc4_init (&arc4, &p, sizeof p);
+      arc4_crypt (&arc4, page, PAGE_SIZE);
+    }
+}
+
+static void
+check (int pass)
+{
+  size_t p;
+
+  for (p = 0; p < PAGE_CNT; p++)
+    {
+      expected (p, pass);
+      if (memcmp (buf + p * PAGE_SIZE, page, PAGE_SIZE))
+        fail ("page %zu is wrong in pass %d", p, pass);
+    }
+}
+
+void
+test_main (void)
+{
+  size_t p;
+
+  msg ("fill memory");
+  for (p = 0; p < PAGE_CNT; p++)
+    {
+      expected (p, 0);
+      memcpy (buf + p * PAGE_SIZE, page, PAGE_SIZE);
+    }
+  check (0);
+
+  msg ("rewrite even pages");
+  for (p = 0; p < PAGE_CNT; p += 2)
+    {
+      expected (p, 1);
+      memcpy (buf + p * PAGE_SIZE, page, PAGE_SIZE);
+    }
+  check (1);
+}
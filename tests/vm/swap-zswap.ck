@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::vm::stats;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(swap-zswap) begin
+(swap-zswap) fill memory
+(swap-zswap) rewrite even pages
+(swap-zswap) end
+EOF
+my ($stored) = get_stats (qr/^Zswap: (\d+) pages stored/);
+fail "no page was stored compressed\n" if $stored == 0;
+pass;
@@ -144,26 +144,34 @@ bss_init (void) {
  * Points base_pml4 to the pml4 it creates. */
 static void
 paging_init (uint64_t mem_end) {
-	uint64_t *pml4, *pte;
-	int perm;
+	uint64_t *pml4;
 	pml4 = base_pml4 = palloc_get_page (PAL_ASSERT | PAL_ZERO);
 
 	extern char start, _end_kernel_text;
 	// Maps physical address [0 ~ mem_end] to
 	//   [LOADER_KERN_BASE ~ LOADER_KERN_BASE + mem_end].
-	for (uint64_t pa = 0; pa < mem_end; pa += PGSIZE) {
-		uint64_t va = (uint64_t) ptov(pa);
-
-		perm = PTE_P | PTE_W;
-		if ((uint64_t) &start <= va && va < (uint64_t) &_end_kernel_text)
-			perm &= ~PTE_W;
+	// The mappings are global, since every pml4 shares them.
+	// Pages from start up to _end_kernel_text are read-only. Everything
+	// else is mapped with large pages as far as alignment allows, so only
+	// the edges of the kernel text need 4 kB pages.
+	uint64_t bounds[] = {
+		0,
+		vtop (pg_round_up (&start)),
+		vtop (pg_round_up (&_end_kernel_text)),
+		(uint64_t) pg_round_up (mem_end),
+	};
+	for (int i = 0; i < 3; i++) {
+		uint64_t perm = PTE_P | PTE_G | (i == 1 ? 0 : PTE_W);
 
-		if ((pte = pml4e_walk (pml4, va, 1)) != NULL)
-			*pte = pa | perm;
+		if (bounds[i] < bounds[i + 1]
+				&& !pml4_map_range (pml4, (uint64_t) ptov (bounds[i]), bounds[i],
+					bounds[i + 1] - bounds[i], perm))
+			PANIC ("out of memory for the kernel page tables");
 	}
 
-	// reload cr3
+	// reload cr3, then turn on global pages and PCIDs.
 	pml4_activate(0);
+	tlb_init ();
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -225,6 +233,20 @@ parse_options (char **argv) {
 			user_page_limit = atoi (value);
 		else if (!strcmp (name, "-threads-tests"))
 			thread_tests = true;
+#endif
+#ifdef VM
+		else if (!strcmp (name, "-evict")) {
+			if (!vm_set_evict_policy (value))
+				PANIC ("unknown eviction policy `%s' (use -h for help)", value);
+		}
+		else if (!strcmp (name, "-swap-ra"))
+			anon_set_readahead (atoi (value));
+		else if (!strcmp (name, "-zswap"))
+			zswap_set_size (atoi (value));
+		else if (!strcmp (name, "-pt-discard"))
+			vm_set_pt_discard (true);
+		else if (!strcmp (name, "-ksm"))
+			vm_set_ksm_rate (atoi (value));
 #endif
 		else
 			PANIC ("unknown option `%s' (use -h for help)", name);
@@ -327,6 +349,19 @@ usage (void) {
 			"  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
 			"  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+			"  -evict=POLICY      Evict frames by POLICY: clock (default),\n"
+			"                     eclock (enhanced clock) or wsclock.\n"
+			"  -swap-ra=PAGES     Read up to PAGES neighbouring pages ahead\n"
+			"                     on swap-in (default 8, 0 disables).\n"
+			"  -zswap=PAGES       Keep up to PAGES pages of compressed swap\n"
+			"                     in memory (default 0, disabled).\n"
+			"  -pt-discard        Free the page tables of regions that\n"
+			"                     eviction leaves with no page in memory.\n"
+			"  -ksm=FRAMES        Merge identical anonymous pages, looking\n"
+			"                     at FRAMES frames every 20 ticks (default\n"
+			"                     0, disabled).\n"
 #endif
 			);
 	power_off ();
@@ -361,4 +396,7 @@ print_stats (void) {
 #ifdef USERPROG
 	exception_print_stats ();
 #endif
+#ifdef VM
+	vm_print_stats ();
+#endif
 }
@@ -2,18 +2,103 @@
 #include <stddef.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/mmu.h"
 #include "intrinsic.h"
 
+/* Control register bits for global pages and PCIDs. */
+#define CR4_PGE (1UL << 7)
+#define CR4_PCIDE (1UL << 17)
+#define CR3_NOFLUSH (1UL << 63)
+
+/* Process-context identifiers tag TLB entries with the address space they
+ * belong to, so that loading CR3 need not flush them. PCID 0 belongs to
+ * base_pml4; the others are handed out to user pml4s as they are
+ * activated, taking one from another pml4 when all are in use. A pml4
+ * whose entries changed while it was not active is STALE, and flushes
+ * its PCID the next time it is loaded. */
+#define PCID_CNT 64
+
+struct pcid_slot {
+	uint64_t *pml4;             /* Owner, or null if free. */
+	bool stale;                 /* Flush on the next activation? */
+};
+
+static bool pcid_enabled;
+static struct pcid_slot pcid_slots[PCID_CNT];
+static size_t pcid_hand;
+
+static bool pml4_is_active (uint64_t *pml4);
+static void tlb_invalidate (struct tlb_gather *tlb, uint64_t *pml4,
+		const void *va);
+
+/* Page tables set aside by pml4_set_huge_page (), one for each 2 MB user
+ * page mapped, for pde_split () to use. A large page is split on the way
+ * to unmapping one of its pages, which must not fail for want of kernel
+ * memory: the frame would be freed while the large page still maps it.
+ * The tables are chained through their first entry. */
+static uint64_t *pt_reserve;
+
+/* Sets PT aside for a large page. */
+static void
+pt_reserve_put (uint64_t *pt) {
+	enum intr_level old_level = intr_disable ();
+
+	pt[0] = (uint64_t) pt_reserve;
+	pt_reserve = pt;
+	intr_set_level (old_level);
+}
+
+/* Takes back the page table set aside for a large page that is going
+ * away, split or not. */
+static uint64_t *
+pt_reserve_take (void) {
+	enum intr_level old_level = intr_disable ();
+	uint64_t *pt = pt_reserve;
+
+	ASSERT (pt != NULL);
+	pt_reserve = (uint64_t *) pt[0];
+	intr_set_level (old_level);
+	return pt;
+}
+
+/* Replaces the 2 MB user page mapped by *PDE with a page table of 4 kB
+ * pages that map the same memory with the same permissions, accessed and
+ * dirty bits, so that they can be changed one at a time. VA is an address
+ * in the large page. The page table is the one set aside when the large
+ * page was mapped, so this cannot fail. */
+static void
+pde_split (uint64_t *pde, const uint64_t va) {
+	uint64_t *pt = pt_reserve_take ();
+	uint64_t pa = PTE_ADDR (*pde);
+	uint64_t flags = *pde & PTE_FLAGS & ~(uint64_t) PTE_PS;
+
+	ASSERT (*pde & PTE_U);
+
+	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++)
+		pt[i] = (pa + i * PGSIZE) | flags;
+	*pde = vtop (pt) | PTE_U | PTE_W | PTE_P;
+
+	/* Drop the TLB entry for the large page, if this pml4 is active. */
+	invlpg (va);
+}
+
+/* Is E the entry of a 2 MB user page, present or left not present by
+ * pml4_clear_range ()? Each such entry has a page table set aside. */
+static bool
+pde_is_huge_user (uint64_t e) {
+	return (e & (PTE_PS | PTE_U)) == (PTE_PS | PTE_U);
+}
+
 static uint64_t *
 pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
 	int idx = PDX (va);
 	if (pdp) {
 		uint64_t *pte = (uint64_t *) pdp[idx];
-		if (!((uint64_t) pte & PTE_P)) {
+		if (!((uint64_t) pte & PTE_P) && !pde_is_huge_user (pdp[idx])) {
 			if (create) {
 				uint64_t *new_page = palloc_get_page (PAL_ZERO);
 				if (new_page)
@@ -23,6 +108,14 @@ pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
 			} else
 				return NULL;
 		}
+		/* A user large page is split to reach the PTE for VA. One that is
+		 * not present is, like a missing page table, only if CREATE. */
+		if (pdp[idx] & PTE_PS) {
+			if (!pde_is_huge_user (pdp[idx])
+					|| (!(pdp[idx] & PTE_P) && !create))
+				return NULL;
+			pde_split (&pdp[idx], va);
+		}
 		return (uint64_t *) ptov (PTE_ADDR (pdp[idx]) + 8 * PTX (va));
 	}
 	return NULL;
@@ -45,7 +138,8 @@ pdpe_walk (uint64_t *pdpe, const uint64_t va, int create) {
 					return NULL;
 			} else
 				return NULL;
-		}
+		} else if (pdpe[idx] & PTE_PS)
+			return NULL;
 		pte = pgdir_walk (ptov (PTE_ADDR (pdpe[idx])), va, create);
 	}
 	if (pte == NULL && allocated) {
@@ -88,6 +182,140 @@ pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
 	return pte;
 }
 
+/* Does the CPU support 1 GB pages? */
+static bool
+cpu_has_1g_pages (void) {
+	uint32_t regs[4];
+
+	cpuid (0x80000000, regs);
+	if (regs[0] < 0x80000001)
+		return false;
+	cpuid (0x80000001, regs);
+	return (regs[3] & (1u << 26)) != 0;
+}
+
+/* Returns the entry for VA in the table at depth LEVEL of PML4: 0 for the
+ * PML4 itself, then the page directory pointer table, the page directory
+ * and the page table. Missing tables on the way are allocated if CREATE
+ * is true. Returns NULL if a table is missing and cannot be created, or
+ * if a large page already covers VA. */
+static uint64_t *
+pml4_entry (uint64_t *pml4, uint64_t va, int level, bool create) {
+	static const unsigned shift[] = {
+		PML4SHIFT, PDPESHIFT, PDXSHIFT, PTXSHIFT
+	};
+	uint64_t *table = pml4;
+
+	for (int i = 0; i < level; i++) {
+		uint64_t *e = &table[(va >> shift[i]) & 0x1FF];
+
+		if (!(*e & PTE_P)) {
+			uint64_t *new_page = create ? palloc_get_page (PAL_ZERO) : NULL;
+			if (new_page == NULL)
+				return NULL;
+			*e = vtop (new_page) | PTE_U | PTE_W | PTE_P;
+		} else if (*e & PTE_PS)
+			return NULL;
+		table = ptov (PTE_ADDR (*e));
+	}
+	return &table[(va >> shift[level]) & 0x1FF];
+}
+
+/* Maps the SIZE bytes of physical memory at PA to virtual address VA in
+ * PML4 with the PTE flags PERM. Wherever VA, PA and the remaining size line
+ * up, uses 1 GB pages if the CPU has them, then 2 MB pages, and 4 kB pages
+ * elsewhere. The range must not be mapped yet. Returns false if memory for
+ * page tables runs out.
+ * This is for the kernel's own mappings; the user half of a pml4 only ever
+ * holds 4 kB pages. */
+bool
+pml4_map_range (uint64_t *pml4, uint64_t va, uint64_t pa, uint64_t size,
+		uint64_t perm) {
+	bool has_1g = cpu_has_1g_pages ();
+
+	ASSERT (pg_ofs (va) == 0 && pg_ofs (pa) == 0 && pg_ofs (size) == 0);
+
+	while (size > 0) {
+		uint64_t step, *pte;
+
+		if (has_1g && (va | pa) % PGSIZE_1G == 0 && size >= PGSIZE_1G) {
+			step = PGSIZE_1G;
+			pte = pml4_entry (pml4, va, 1, true);
+		} else if ((va | pa) % PGSIZE_2M == 0 && size >= PGSIZE_2M) {
+			step = PGSIZE_2M;
+			pte = pml4_entry (pml4, va, 2, true);
+		} else {
+			step = PGSIZE;
+			pte = pml4_entry (pml4, va, 3, true);
+		}
+		if (pte == NULL)
+			return false;
+		*pte = pa | perm | (step != PGSIZE ? PTE_PS : 0);
+
+		va += step;
+		pa += step;
+		size -= step;
+	}
+	return true;
+}
+
+/* Returns the PDE in PML4 of the 2 MB user page that covers VA, or a null
+ * pointer if VA is not in a large page. */
+static uint64_t *
+pml4_huge_pde (uint64_t *pml4, const void *va) {
+	uint64_t *pde = pml4_entry (pml4, (uint64_t) va, 2, false);
+
+	if (pde != NULL && (*pde & (PTE_P | PTE_PS)) == (PTE_P | PTE_PS))
+		return pde;
+	return NULL;
+}
+
+/* Is VA mapped by a 2 MB page in PML4? */
+bool
+pml4_is_huge_page (uint64_t *pml4, const void *va) {
+	return pml4_huge_pde (pml4, va) != NULL;
+}
+
+/* Maps the 2 MB of user virtual memory at UPAGE to the 2 MB of physical
+ * memory at kernel virtual address KPAGE with a single large page. None of
+ * the pages in the range may be mapped.
+ * The large page is split into 4 kB pages by the first call that changes
+ * the mapping or the bits of one of its pages, such as pml4_clear_page ()
+ * or pml4_set_writable (). The page table for that is allocated now, or
+ * kept from earlier mappings of the range, so that splitting never
+ * fails. Returns false if memory allocation failed. */
+bool
+pml4_set_huge_page (uint64_t *pml4, void *upage, void *kpage, bool rw) {
+	uint64_t *pde, *pt;
+
+	ASSERT ((uint64_t) upage % PGSIZE_2M == 0);
+	ASSERT (vtop (kpage) % PGSIZE_2M == 0);
+	ASSERT (is_user_vaddr (upage));
+	ASSERT (pml4 != base_pml4);
+
+	pde = pml4_entry (pml4, (uint64_t) upage, 2, true);
+	if (pde == NULL)
+		return false;
+	if (pde_is_huge_user (*pde)) {
+		/* A large page left not present still has its table set aside. */
+		ASSERT (!(*pde & PTE_P));
+	} else if (*pde & PTE_P) {
+		pt = ptov (PTE_ADDR (*pde));
+		ASSERT (!(*pde & PTE_PS));
+		for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++)
+			ASSERT (!(pt[i] & PTE_P));
+		pt_reserve_put (pt);
+	} else {
+		pt = palloc_get_page (0);
+		if (pt == NULL)
+			return false;
+		pt_reserve_put (pt);
+	}
+	*pde = vtop (kpage) | PTE_PS | PTE_P | (rw ? PTE_W : 0) | PTE_U;
+	tlb_invalidate (NULL, pml4, upage);
+	return true;
+}
+
 /* Creates a new page map level 4 (pml4) has mappings for kernel
  * virtual addresses, but none for user virtual addresses.
  * Returns the new page directory, or a null pointer if memory
@@ -122,7 +350,8 @@ pgdir_for_each (uint64_t *pdp, pte_for_each_func *func, void *aux,
 		unsigned pml4_index, unsigned pdp_index) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
+		/* Large pages have no PTEs. */
+		if ((((uint64_t) pte) & PTE_P) && !(pdp[i] & PTE_PS))
 			if (!pt_for_each ((uint64_t *) PTE_ADDR (pte), func, aux,
 					pml4_index, pdp_index, i))
 				return false;
@@ -135,7 +364,7 @@ pdp_for_each (uint64_t *pdp,
 		pte_for_each_func *func, void *aux, unsigned pml4_index) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pde = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pde) & PTE_P)
+		if ((((uint64_t) pde) & PTE_P) && !(pdp[i] & PTE_PS))
 			if (!pgdir_for_each ((uint64_t *) PTE_ADDR (pde), func,
 					 aux, pml4_index, i))
 				return false;
@@ -169,8 +398,12 @@ static void
 pgdir_destroy (uint64_t *pdp) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
+		/* The frames of a large page belong to the VM's frame table, but
+		 * the page table set aside for it is freed here. */
+		if ((((uint64_t) pte) & PTE_P) && !(pdp[i] & PTE_PS))
 			pt_destroy (PTE_ADDR (pte));
+		else if (pde_is_huge_user (pdp[i]))
+			palloc_free_page (pt_reserve_take ());
 	}
 	palloc_free_page ((void *) pdp);
 }
@@ -185,12 +418,71 @@ pdpe_destroy (uint64_t *pdpe) {
 	palloc_free_page ((void *) pdpe);
 }
 
+/* Returns the PCID slot of PML4, or a null pointer if it has none. Must
+ * be called with interrupts off. */
+static struct pcid_slot *
+pcid_lookup (uint64_t *pml4) {
+	for (size_t i = 1; i < PCID_CNT; i++)
+		if (pcid_slots[i].pml4 == pml4)
+			return &pcid_slots[i];
+	return NULL;
+}
+
+/* Returns the value to load into CR3 to activate PML4, giving PML4 a PCID
+ * if it has none. Must be called with interrupts off. */
+static uint64_t
+pcid_cr3 (uint64_t *pml4) {
+	struct pcid_slot *slot;
+	bool flush;
+
+	if (pml4 == base_pml4)
+		return vtop (pml4) | CR3_NOFLUSH;
+
+	slot = pcid_lookup (pml4);
+	if (slot == NULL) {
+		/* Round robin; the previous owner, if any, will get another
+		 * PCID, and whatever it left in the TLB is flushed below. */
+		pcid_hand = pcid_hand % (PCID_CNT - 1) + 1;
+		slot = &pcid_slots[pcid_hand];
+		slot->pml4 = pml4;
+		slot->stale = true;
+	}
+	flush = slot->stale;
+	slot->stale = false;
+	return vtop (pml4) | (slot - pcid_slots) | (flush ? 0 : CR3_NOFLUSH);
+}
+
+/* Notes that an entry of PML4, which is not active, changed. */
+static void
+pcid_mark_stale (uint64_t *pml4) {
+	enum intr_level old_level;
+	struct pcid_slot *slot;
+
+	if (!pcid_enabled)
+		return;
+	old_level = intr_disable ();
+	slot = pcid_lookup (pml4);
+	if (slot != NULL)
+		slot->stale = true;
+	intr_set_level (old_level);
+}
+
 /* Destroys pml4e, freeing all the pages it references. */
 void
 pml4_destroy (uint64_t *pml4) {
 	if (pml4 == NULL)
 		return;
 	ASSERT (pml4 != base_pml4);
+	ASSERT (!pml4_is_active (pml4));
+
+	if (pcid_enabled) {
+		enum intr_level old_level = intr_disable ();
+		struct pcid_slot *slot = pcid_lookup (pml4);
+
+		if (slot != NULL)
+			slot->pml4 = NULL;
+		intr_set_level (old_level);
+	}
 
 	/* if PML4 (vaddr) >= 1, it's kernel space by define. */
 	uint64_t *pdpe = ptov ((uint64_t *) pml4[0]);
@@ -200,10 +492,47 @@ pml4_destroy (uint64_t *pml4) {
 }
 
 /* Loads page directory PD into the CPU's page directory base
- * register. */
+ * register. With PCIDs, the TLB entries of PD survive from the last time
+ * it was active, unless it changed in between. */
 void
 pml4_activate (uint64_t *pml4) {
-	lcr3 (vtop (pml4 ? pml4 : base_pml4));
+	enum intr_level old_level;
+
+	if (pml4 == NULL)
+		pml4 = base_pml4;
+	if (!pcid_enabled) {
+		lcr3 (vtop (pml4));
+		return;
+	}
+	old_level = intr_disable ();
+	lcr3 (pcid_cr3 (pml4));
+	intr_set_level (old_level);
+}
+
+/* Is PML4 the page table in use? CR3 holds the PCID in its low bits. */
+static bool
+pml4_is_active (uint64_t *pml4) {
+	return PTE_ADDR (rcr3 ()) == vtop (pml4);
+}
+
+/* Turns on global pages, so that the kernel's mappings survive CR3 loads,
+ * and PCIDs, if the CPU has them. base_pml4 must be active. */
+void
+tlb_init (void) {
+	uint32_t regs[4];
+	uint64_t cr4;
+
+	ASSERT (rcr3 () == vtop (base_pml4));
+
+	cpuid (1, regs);
+	cr4 = rcr4 ();
+	if (regs[3] & (1u << 13))
+		cr4 |= CR4_PGE;
+	if (regs[2] & (1u << 17)) {
+		cr4 |= CR4_PCIDE;
+		pcid_enabled = true;
+	}
+	lcr4 (cr4);
 }
 
 /* Looks up the physical address that corresponds to user virtual
@@ -214,6 +543,10 @@ void *
 pml4_get_page (uint64_t *pml4, const void *uaddr) {
 	ASSERT (is_user_vaddr (uaddr));
 
+	uint64_t *pde = pml4_huge_pde (pml4, uaddr);
+	if (pde != NULL)
+		return ptov (PTE_ADDR (*pde)) + ((uint64_t) uaddr & (PGSIZE_2M - 1));
+
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) uaddr, 0);
 
 	if (pte && (*pte & PTE_P))
@@ -243,12 +576,59 @@ pml4_set_page (uint64_t *pml4, void *upage, void *kpage, bool rw) {
 	return pte != NULL;
 }
 
+/* Starts TLB as an empty batch of invalidations for PML4. */
+void
+tlb_gather_init (struct tlb_gather *tlb, uint64_t *pml4) {
+	tlb->pml4 = pml4;
+	tlb->cnt = 0;
+	tlb->full = false;
+}
+
+/* Invalidates the TLB entry for VA in PML4, whose page table entry has
+ * changed: right away if TLB is null or gathers for another page table,
+ * otherwise by recording VA in TLB. invlpg only reaches the active page
+ * table, so another one is flushed as a whole when it is next loaded. */
+static void
+tlb_invalidate (struct tlb_gather *tlb, uint64_t *pml4, const void *va) {
+	if (!pml4_is_active (pml4)) {
+		pcid_mark_stale (pml4);
+		return;
+	}
+	if (tlb == NULL || tlb->pml4 != pml4)
+		invlpg ((uint64_t) va);
+	else if (tlb->cnt < TLB_GATHER_MAX)
+		tlb->pages[tlb->cnt++] = (uint64_t) va;
+	else
+		tlb->full = true;
+}
+
+/* Performs the invalidations gathered in TLB, with one CR3 reload if
+ * there were more than TLB_GATHER_MAX, and empties it. */
+void
+tlb_gather_finish (struct tlb_gather *tlb) {
+	if (tlb->full)
+		lcr3 (rcr3 ());
+	else
+		for (size_t i = 0; i < tlb->cnt; i++)
+			invlpg (tlb->pages[i]);
+	tlb->cnt = 0;
+	tlb->full = false;
+}
+
 /* Marks user virtual page UPAGE "not present" in page
  * directory PD.  Later accesses to the page will fault.  Other
  * bits in the page table entry are preserved.
  * UPAGE need not be mapped. */
 void
 pml4_clear_page (uint64_t *pml4, void *upage) {
+	pml4_clear_page_batch (pml4, upage, NULL);
+}
+
+/* Like pml4_clear_page (), but leaves the TLB entry for UPAGE to
+ * tlb_gather_finish (TLB). */
+void
+pml4_clear_page_batch (uint64_t *pml4, void *upage,
+		struct tlb_gather *tlb) {
 	uint64_t *pte;
 	ASSERT (pg_ofs (upage) == 0);
 	ASSERT (is_user_vaddr (upage));
@@ -257,8 +637,7 @@ pml4_clear_page (uint64_t *pml4, void *upage) {
 
 	if (pte != NULL && (*pte & PTE_P) != 0) {
 		*pte &= ~PTE_P;
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) upage);
+		tlb_invalidate (tlb, pml4, upage);
 	}
 }
 
@@ -268,24 +647,57 @@ pml4_clear_page (uint64_t *pml4, void *upage) {
  * Returns false if PML4 contains no PTE for VPAGE. */
 bool
 pml4_is_dirty (uint64_t *pml4, const void *vpage) {
-	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
+	uint64_t *pte = pml4_huge_pde (pml4, vpage);
+	if (pte == NULL)
+		pte = pml4e_walk (pml4, (uint64_t) vpage, false);
 	return pte != NULL && (*pte & PTE_D) != 0;
 }
 
+/* Sets BIT in *PTE if ON, otherwise clears it. Returns whether *PTE
+ * changed in a way the TLB may have cached. */
+static bool
+pte_update (uint64_t *pte, uint64_t bit, bool on) {
+	uint64_t old = *pte;
+
+	if (on)
+		*pte |= bit;
+	else
+		*pte &= ~bit;
+	return *pte != old && (old & PTE_P) != 0;
+}
+
 /* Set the dirty bit to DIRTY in the PTE for virtual page VPAGE
  * in PML4. */
 void
 pml4_set_dirty (uint64_t *pml4, const void *vpage, bool dirty) {
+	pml4_set_dirty_batch (pml4, vpage, dirty, NULL);
+}
+
+/* Like pml4_set_dirty (), but leaves the TLB entry for VPAGE to
+ * tlb_gather_finish (TLB). */
+void
+pml4_set_dirty_batch (uint64_t *pml4, const void *vpage, bool dirty,
+		struct tlb_gather *tlb) {
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
-	if (pte) {
-		if (dirty)
-			*pte |= PTE_D;
-		else
-			*pte &= ~(uint32_t) PTE_D;
-
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) vpage);
-	}
+	if (pte && pte_update (pte, PTE_D, dirty))
+		tlb_invalidate (tlb, pml4, vpage);
+}
+
+/* Sets the writable bit to WRITABLE in the PTE for virtual page VPAGE
+ * in PML4. */
+void
+pml4_set_writable (uint64_t *pml4, const void *vpage, bool writable) {
+	pml4_set_writable_batch (pml4, vpage, writable, NULL);
+}
+
+/* Like pml4_set_writable (), but leaves the TLB entry for VPAGE to
+ * tlb_gather_finish (TLB). */
+void
+pml4_set_writable_batch (uint64_t *pml4, const void *vpage, bool writable,
+		struct tlb_gather *tlb) {
+	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
+	if (pte && pte_update (pte, PTE_W, writable))
+		tlb_invalidate (tlb, pml4, vpage);
 }
 
 /* Returns true if the PTE for virtual page VPAGE in PML4 has been
@@ -294,7 +706,9 @@ pml4_set_dirty (uint64_t *pml4, const void *vpage, bool dirty) {
  * PML4 contains no PTE for VPAGE. */
 bool
 pml4_is_accessed (uint64_t *pml4, const void *vpage) {
-	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
+	uint64_t *pte = pml4_huge_pde (pml4, vpage);
+	if (pte == NULL)
+		pte = pml4e_walk (pml4, (uint64_t) vpage, false);
 	return pte != NULL && (*pte & PTE_A) != 0;
 }
 
@@ -302,14 +716,292 @@ pml4_is_accessed (uint64_t *pml4, const void *vpage) {
    VPAGE in PD. */
 void
 pml4_set_accessed (uint64_t *pml4, const void *vpage, bool accessed) {
-	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
-	if (pte) {
-		if (accessed)
-			*pte |= PTE_A;
-		else
-			*pte &= ~(uint32_t) PTE_A;
-
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) vpage);
+	pml4_set_accessed_batch (pml4, vpage, accessed, NULL);
+}
+
+/* Like pml4_set_accessed (), but leaves the TLB entry for VPAGE to
+ * tlb_gather_finish (TLB). A 2 MB page is not split: its one accessed bit,
+ * which stands for all of its pages, is set or cleared. */
+void
+pml4_set_accessed_batch (uint64_t *pml4, const void *vpage, bool accessed,
+		struct tlb_gather *tlb) {
+	uint64_t *pte = pml4_huge_pde (pml4, vpage);
+	if (pte == NULL)
+		pte = pml4e_walk (pml4, (uint64_t) vpage, false);
+	if (pte && pte_update (pte, PTE_A, accessed))
+		tlb_invalidate (tlb, pml4, vpage);
+}
+
+/* Returns the page directory entry for VA in PML4, or a null pointer if a
+ * table above it is missing or a large page covers it, in which case *NEXT
+ * is set to the first address past the hole. */
+static uint64_t *
+range_pde (uint64_t *pml4, uint64_t va, uint64_t *next) {
+	static const unsigned shift[] = { PML4SHIFT, PDPESHIFT };
+	uint64_t *table = pml4;
+
+	for (int i = 0; i < 2; i++) {
+		uint64_t e = table[(va >> shift[i]) & 0x1FF];
+
+		if (!(e & PTE_P) || (e & PTE_PS)) {
+			*next = (va | ((1UL << shift[i]) - 1)) + 1;
+			return NULL;
+		}
+		table = ptov (PTE_ADDR (e));
+	}
+	return &table[PDX (va)];
+}
+
+/* An update of the entries in a range of a pml4 by pml4_update_range (). */
+struct range_update {
+	uint64_t *pml4;
+	uint64_t test;              /* Count the pages with any of these. */
+	uint64_t clear;             /* Then clear these bits, */
+	uint64_t set;               /* and set these. */
+	struct tlb_gather *tlb;     /* Gathers invalidations if PML4 is active. */
+	bool active;                /* Is PML4 the page table in use? */
+	bool changed;               /* Has any entry changed? */
+	size_t hits;                /* Pages with any of the bits TEST. */
+};
+
+/* Applies U to the CNT entries at PTE, which map pages of STEP bytes from
+ * VA on. Entries that are not present are left alone. WEIGHT is the
+ * number of pages each entry stands for. */
+static void
+pte_update_many (struct range_update *u, uint64_t *pte, size_t cnt,
+		uint64_t va, uint64_t step, size_t weight) {
+	for (size_t i = 0; i < cnt; i++, va += step) {
+		uint64_t old = pte[i];
+
+		if (!(old & PTE_P))
+			continue;
+		if (old & u->test)
+			u->hits += weight;
+		pte[i] = (old & ~u->clear) | u->set;
+		if (pte[i] != old) {
+			u->changed = true;
+			if (u->active)
+				tlb_invalidate (u->tlb, u->pml4, (void *) va);
+		}
+	}
+}
+
+/* Counts the pages mapped in [START, END) of PML4 with any of the bits
+ * TEST, then clears the bits CLEAR and sets the bits SET in their entries.
+ * Works one page table at a time, skipping the parts of the range that
+ * have no page tables. A 2 MB page wholly in the range is changed as a
+ * unit; one partly in it is split first. Returns the count. */
+static size_t
+pml4_update_range (uint64_t *pml4, void *start, void *end, uint64_t test,
+		uint64_t clear, uint64_t set, struct tlb_gather *tlb) {
+	struct range_update u = {
+		.pml4 = pml4, .test = test, .clear = clear, .set = set, .tlb = tlb,
+		.active = pml4_is_active (pml4),
+	};
+	uint64_t va = (uint64_t) start;
+
+	ASSERT (pg_ofs (start) == 0 && pg_ofs (end) == 0);
+	ASSERT ((uint64_t) end <= KERN_BASE);
+
+	while (va < (uint64_t) end) {
+		uint64_t next = (va | (PGSIZE_2M - 1)) + 1;
+		uint64_t *pde = range_pde (pml4, va, &next);
+
+		if (next > (uint64_t) end)
+			next = (uint64_t) end;
+		if (pde == NULL || !(*pde & PTE_P)) {
+			va = next;
+			continue;
+		}
+		if ((*pde & PTE_PS) && next - va == PGSIZE_2M)
+			pte_update_many (&u, pde, 1, va, PGSIZE_2M, PGSIZE_2M / PGSIZE);
+		else if ((*pde & PTE_PS) && clear == 0 && set == 0) {
+			if (*pde & test)
+				u.hits += (next - va) / PGSIZE;
+		} else if (!(*pde & PTE_PS) || (*pde & PTE_U)) {
+			if (*pde & PTE_PS)
+				pde_split (pde, va);
+			pte_update_many (&u, (uint64_t *) ptov (PTE_ADDR (*pde)) + PTX (va),
+					(next - va) / PGSIZE, va, PGSIZE, 1);
+		}
+		va = next;
+	}
+	if (!u.active && u.changed)
+		pcid_mark_stale (pml4);
+	return u.hits;
+}
+
+/* Maps the CNT user pages from UPAGE on to the frames at the kernel
+ * virtual addresses KPAGES, read/write if RW, like CNT calls to
+ * pml4_set_page () but walking down to each page table once. None of the
+ * pages may be mapped yet. Returns false if memory allocation failed, in
+ * which case some of the pages may be mapped. */
+bool
+pml4_set_pages (uint64_t *pml4, void *upage, void **kpages, size_t cnt,
+		bool rw) {
+	ASSERT (pg_ofs (upage) == 0);
+	ASSERT (is_user_vaddr ((uint8_t *) upage + cnt * PGSIZE - 1));
+	ASSERT (pml4 != base_pml4);
+
+	for (size_t i = 0; i < cnt; ) {
+		uint64_t va = (uint64_t) upage + i * PGSIZE;
+		uint64_t *pte = pml4e_walk (pml4, va, true);
+		size_t n = (PGSIZE_2M - va % PGSIZE_2M) / PGSIZE;
+
+		if (pte == NULL)
+			return false;
+		if (n > cnt - i)
+			n = cnt - i;
+		for (size_t j = 0; j < n; j++, i++) {
+			ASSERT (pg_ofs (kpages[i]) == 0);
+			pte[j] = vtop (kpages[i]) | PTE_P | (rw ? PTE_W : 0) | PTE_U;
+		}
+	}
+	return true;
+}
+
+/* Marks the user pages in [START, END) of PML4 not present, like
+ * pml4_clear_page () on each, leaving the TLB entries to TLB. */
+void
+pml4_clear_range (uint64_t *pml4, void *start, void *end,
+		struct tlb_gather *tlb) {
+	pml4_update_range (pml4, start, end, 0, PTE_P, 0, tlb);
+}
+
+/* Sets the writable bit of the user pages mapped in [START, END) of PML4
+ * to WRITABLE, leaving the TLB entries to TLB. */
+void
+pml4_protect_range (uint64_t *pml4, void *start, void *end, bool writable,
+		struct tlb_gather *tlb) {
+	pml4_update_range (pml4, start, end, 0, writable ? 0 : PTE_W,
+			writable ? PTE_W : 0, tlb);
+}
+
+/* Returns how many of the user pages mapped in [START, END) of PML4 have
+ * any of BITS, a mask of PTE_A and PTE_D, set. If CLEAR, also clears
+ * BITS, leaving the TLB entries to TLB. */
+size_t
+pml4_collect_range (uint64_t *pml4, void *start, void *end, uint64_t bits,
+		bool clear, struct tlb_gather *tlb) {
+	ASSERT ((bits & ~(uint64_t) (PTE_A | PTE_D)) == 0);
+
+	return pml4_update_range (pml4, start, end, bits, clear ? bits : 0, 0,
+			tlb);
+}
+
+/* Does TABLE have no entries at all, present or not? */
+static bool
+table_is_empty (const uint64_t *table) {
+	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++)
+		if (table[i] != 0)
+			return false;
+	return true;
+}
+
+/* Frees the tables on the way to VA in PML4 that are left without
+ * entries, from the page table up to the page directory pointer table.
+ * Tables that PML4 shares with base_pml4 are kept. Returns the number
+ * of tables freed. */
+static size_t
+pml4_prune (uint64_t *pml4, uint64_t va) {
+	const size_t idx[] = { PML4 (va), PDPE (va), PDX (va) };
+	uint64_t *entry[3];
+	uint64_t *table = pml4;
+	size_t depth, freed = 0;
+
+	if (base_pml4[PML4 (va)] & PTE_P)
+		return 0;
+	for (depth = 0; depth < 3; depth++) {
+		uint64_t *e = &table[idx[depth]];
+
+		if (!(*e & PTE_P) || (*e & PTE_PS))
+			break;
+		entry[depth] = e;
+		table = ptov (PTE_ADDR (*e));
 	}
+	while (depth-- > 0) {
+		uint64_t *child = ptov (PTE_ADDR (*entry[depth]));
+
+		if (!table_is_empty (child))
+			break;
+		*entry[depth] = 0;
+		tlb_invalidate (NULL, pml4, (void *) va);
+		palloc_free_page (child);
+		freed++;
+	}
+	return freed;
+}
+
+/* Removes every entry for the user pages in [START, END) of PML4, unlike
+ * pml4_clear_range (), which keeps them not present, and frees the page
+ * tables this leaves empty. For pages that are gone for good, such as
+ * those of an unmapped region. Returns the number of tables freed. */
+size_t
+pml4_remove_range (uint64_t *pml4, void *start, void *end) {
+	uint64_t va = (uint64_t) start;
+	size_t freed = 0;
+
+	ASSERT (pg_ofs (start) == 0 && pg_ofs (end) == 0);
+	ASSERT ((uint64_t) end <= KERN_BASE);
+
+	while (va < (uint64_t) end) {
+		uint64_t next = (va | (PGSIZE_2M - 1)) + 1;
+		uint64_t *pde = range_pde (pml4, va, &next);
+
+		if (next > (uint64_t) end)
+			next = (uint64_t) end;
+		if (pde == NULL || *pde == 0) {
+			va = next;
+			continue;
+		}
+		if ((*pde & PTE_PS) && next - va == PGSIZE_2M) {
+			uint64_t old = *pde;
+
+			*pde = 0;
+			if (old & PTE_P)
+				tlb_invalidate (NULL, pml4, (void *) va);
+			if (pde_is_huge_user (old))
+				palloc_free_page (pt_reserve_take ());
+		} else if ((*pde & PTE_P)
+				&& (!(*pde & PTE_PS) || pde_is_huge_user (*pde))) {
+			uint64_t *pte;
+
+			if (*pde & PTE_PS)
+				pde_split (pde, va);
+			pte = (uint64_t *) ptov (PTE_ADDR (*pde)) + PTX (va);
+
+			for (uint64_t p = va; p < next; p += PGSIZE, pte++) {
+				if (*pte & PTE_P)
+					tlb_invalidate (NULL, pml4, (void *) p);
+				*pte = 0;
+			}
+		}
+		freed += pml4_prune (pml4, va);
+		va = next;
+	}
+	return freed;
+}
+
+/* Frees the page table of PML4 that maps VA, if none of its pages is
+ * present, along with the tables above it that this leaves empty. What
+ * the entries still held is lost, so the caller must know that none of
+ * the pages is in memory; a fault on one of them builds the table
+ * afresh. Returns true if the page table was freed. */
+bool
+pml4_discard_table (uint64_t *pml4, void *va) {
+	uint64_t *pde = pml4_entry (pml4, (uint64_t) va, 2, false);
+	uint64_t *pt;
+
+	ASSERT (is_user_vaddr (va));
+
+	if (pde == NULL || (*pde & (PTE_P | PTE_PS)) != PTE_P
+			|| (base_pml4[PML4 (va)] & PTE_P))
+		return false;
+	pt = ptov (PTE_ADDR (*pde));
+	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++)
+		if (pt[i] & PTE_P)
+			return false;
+	memset (pt, 0, PGSIZE);
+	pml4_prune (pml4, (uint64_t) va);
+	return true;
 }
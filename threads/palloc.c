@@ -8,6 +8,7 @@
 #include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -31,6 +32,7 @@ struct pool {
 	struct lock lock;               /* Mutual exclusion. */
 	struct bitmap *used_map;        /* Bitmap of free pages. */
 	uint8_t *base;                  /* Base of pool. */
+	size_t free_cnt;                /* Number of free pages. */
 };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -250,6 +252,10 @@ palloc_init (void) {
 	printf ("\text_mem: 0x%llx ~ 0x%llx (Usable: %'llu kB)\n",
 		  ext_mem.start, ext_mem.end, ext_mem.size / 1024);
 	populate_pools (&base_mem, &ext_mem);
+	kernel_pool.free_cnt = bitmap_count (kernel_pool.used_map, 0,
+			bitmap_size (kernel_pool.used_map), false);
+	user_pool.free_cnt = bitmap_count (user_pool.used_map, 0,
+			bitmap_size (user_pool.used_map), false);
 	return ext_mem.end;
 }
 
@@ -261,10 +267,40 @@ palloc_init (void) {
    FLAGS, in which case the kernel panics. */
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
+	return palloc_get_aligned (flags, page_cnt, 1);
+}
+
+/* Like palloc_get_multiple(), but the first page's physical
+   address is a multiple of ALIGN pages, which must be a power of
+   two. */
+void *
+palloc_get_aligned (enum palloc_flags flags, size_t page_cnt, size_t align) {
 	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+	size_t page_idx = BITMAP_ERROR;
+
+	ASSERT (align > 0 && (align & (align - 1)) == 0);
+
+	enum intr_level old_level;
 
 	lock_acquire (&pool->lock);
-	size_t page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+	if (align == 1)
+		page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+	else {
+		size_t pool_cnt = bitmap_size (pool->used_map);
+		size_t i = ROUND_UP (pg_no (pool->base), align) - pg_no (pool->base);
+
+		for (; i + page_cnt <= pool_cnt; i += align)
+			if (bitmap_none (pool->used_map, i, page_cnt)) {
+				bitmap_set_multiple (pool->used_map, i, page_cnt, true);
+				page_idx = i;
+				break;
+			}
+	}
+	if (page_idx != BITMAP_ERROR) {
+		old_level = intr_disable ();
+		pool->free_cnt -= page_cnt;
+		intr_set_level (old_level);
+	}
 	lock_release (&pool->lock);
 	void *pages;
 
@@ -301,6 +337,7 @@ void
 palloc_free_multiple (void *pages, size_t page_cnt) {
 	struct pool *pool;
 	size_t page_idx;
+	enum intr_level old_level;
 
 	ASSERT (pg_ofs (pages) == 0);
 	if (pages == NULL || page_cnt == 0)
@@ -320,6 +357,11 @@ palloc_free_multiple (void *pages, size_t page_cnt) {
 #endif
 	ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
 	bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+
+	/* Pages may be freed with interrupts off, so no lock here. */
+	old_level = intr_disable ();
+	pool->free_cnt += page_cnt;
+	intr_set_level (old_level);
 }
 
 /* Frees the page at PAGE. */
@@ -328,6 +370,22 @@ palloc_free_page (void *page) {
 	palloc_free_multiple (page, 1);
 }
 
+/* Returns the kernel virtual address of the first page of the
+   user pool and stores the number of pages in the pool into
+   *PAGE_CNT.  Every page that palloc_get_page (PAL_USER) can
+   return lies in this range. */
+void *
+palloc_user_pool (size_t *page_cnt) {
+	*page_cnt = bitmap_size (user_pool.used_map);
+	return user_pool.base;
+}
+
+/* Returns the number of free pages in the user pool. */
+size_t
+palloc_user_free_cnt (void) {
+	return user_pool.free_cnt;
+}
+
 /* Initializes pool P as starting at START and ending at END */
 static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
@@ -170,6 +170,10 @@ thread_tick (void) {
 	else
 		kernel_ticks++;
 
+#ifdef VM
+	vm_tick ();
+#endif
+
 	/* Enforce preemption. */
 	if (++thread_ticks >= TIME_SLICE)
 		intr_yield_on_return ();
@@ -747,6 +751,10 @@ void set_load_avg(){
 void thread_preempt(){
 	if(!list_empty(&ready_list)){
 		struct thread *t = list_entry(list_front(&ready_list), struct thread, elem);
-		if((thread_current() != idle_thread) && thread_current()->priority < t->priority) thread_yield();
+		if((thread_current() != idle_thread) && thread_current()->priority < t->priority){
+			/* Called from sema_up () in an interrupt handler, too. */
+			if(intr_context()) intr_yield_on_return();
+			else thread_yield();
+		}
 	}
 }
\ No newline at end of file
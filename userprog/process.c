@@ -159,6 +159,7 @@ __do_fork (void *aux) {
 	process_activate (current);
 #ifdef VM
 	supplemental_page_table_init (&current->spt);
+	current->rss_limit = parent->rss_limit;
 	if (!supplemental_page_table_copy (&current->spt, &parent->spt))
 		goto error;
 #else
@@ -684,13 +685,6 @@ install_page (void *upage, void *kpage, bool writable) {
  * If you want to implement the function for only project 2, implement it on the
  * upper block. */
 
-static bool
-lazy_load_segment (struct page *page, void *aux) {
-	/* TODO: Load the segment from the file */
-	/* TODO: This called when the first page fault occurs on address VA. */
-	/* TODO: VA is available when calling this function. */
-}
-
 /* Loads a segment starting at offset OFS in FILE at address
  * UPAGE.  In total, READ_BYTES + ZERO_BYTES bytes of virtual
  * memory are initialized, as follows:
@@ -712,25 +706,48 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 	ASSERT (pg_ofs (upage) == 0);
 	ASSERT (ofs % PGSIZE == 0);
 
-	while (read_bytes > 0 || zero_bytes > 0) {
+	/* All pages with file data share one region, which also lets faults
+	 * on them read ahead. */
+	struct file_region *seg = file_region_create (file, ofs, upage,
+			(read_bytes + zero_bytes) / PGSIZE, read_bytes);
+	bool success = true;
+
+	if (seg == NULL)
+		return false;
+	if (vma_insert (&thread_current ()->spt.vmas, upage,
+				upage + read_bytes + zero_bytes, VMA_EXEC, writable, seg) == NULL) {
+		vm_aux_put (&seg->aux);
+		return false;
+	}
+
+	while (success && (read_bytes > 0 || zero_bytes > 0)) {
 		/* Do calculate how to fill this page.
 		 * We will read PAGE_READ_BYTES bytes from FILE
 		 * and zero the final PAGE_ZERO_BYTES bytes. */
 		size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
 		size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
-		/* TODO: Set up aux to pass information to the lazy_load_segment. */
-		void *aux = NULL;
-		if (!vm_alloc_page_with_initializer (VM_ANON, upage,
-					writable, lazy_load_segment, aux))
-			return false;
+		if (page_read_bytes == 0)
+			success = vm_alloc_page (VM_ANON, upage, writable);
+		else {
+			vm_aux_get (&seg->aux);
+			/* Read-only pages may share frames with other processes
+			 * running the same executable. */
+			enum vm_type type = VM_ANON | VM_AUX_REF | (writable ? 0 : VM_TEXT);
+
+			success = vm_alloc_page_with_initializer (type, upage, writable,
+					file_region_load, &seg->aux);
+			if (!success)
+				vm_aux_put (&seg->aux);
+		}
 
 		/* Advance. */
 		read_bytes -= page_read_bytes;
 		zero_bytes -= page_zero_bytes;
 		upage += PGSIZE;
 	}
-	return true;
+	vm_aux_put (&seg->aux);
+	return success;
 }
 
 /* Create a PAGE of stack at the USER_STACK. Return true on success. */
@@ -739,11 +756,15 @@ setup_stack (struct intr_frame *if_) {
 	bool success = false;
 	void *stack_bottom = (void *) (((uint8_t *) USER_STACK) - PGSIZE);
 
-	/* TODO: Map the stack on stack_bottom and claim the page immediately.
-	 * TODO: If success, set the rsp accordingly.
-	 * TODO: You should mark the page is stack. */
-	/* TODO: Your code goes here */
-
+	/* The whole of the room the stack may grow into is its area. */
+	if (vma_insert (&thread_current ()->spt.vmas,
+				(uint8_t *) USER_STACK - STACK_LIMIT, (void *) USER_STACK,
+				VMA_STACK, true, NULL) != NULL
+			&& vm_alloc_page (VM_ANON, stack_bottom, true)
+			&& vm_claim_page (stack_bottom)) {
+		if_->rsp = USER_STACK;
+		success = true;
+	}
 	return success;
 }
 #endif /* VM */
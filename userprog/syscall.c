@@ -15,6 +15,9 @@
 #include "string.h"
 #include "userprog/process.h"
 #include "threads/palloc.h"
+#ifdef VM
+#include "vm/vm.h"
+#endif
 
 
 typedef int pid_t;
@@ -36,6 +39,17 @@ int write (int fd, const void *buffer, unsigned size);
 void seek (int fd, unsigned position);
 unsigned tell (int fd);
 void close (int fd);
+#ifdef VM
+void *mmap (void *addr, size_t length, int writable, int fd, off_t offset);
+void munmap (void *addr);
+int msync (void *addr, size_t length);
+size_t set_rss_limit (size_t pages);
+int madvise (void *addr, size_t length, int advice);
+int mlock (void *addr, size_t length);
+int munlock (void *addr, size_t length);
+static int file_transfer (struct file *f, void *buffer, unsigned size,
+		bool is_read);
+#endif
 int add_file(struct file* f);
 struct file *get_file(int fd);
 void check_ptr(void *ptr);
@@ -72,6 +86,11 @@ syscall_init (void) {
 void
 syscall_handler (struct intr_frame *f UNUSED) {
 	int number = f->R.rax;
+#ifdef VM
+	/* Page faults taken on user memory during the call need this to tell
+	 * stack growth from a bad access. */
+	thread_current()->user_rsp = (void *) f->rsp;
+#endif
 	switch (number)
 	{
 		case SYS_HALT:
@@ -116,6 +135,30 @@ syscall_handler (struct intr_frame *f UNUSED) {
 		case SYS_CLOSE:
 			close(f->R.rdi);
 			break;  
+#ifdef VM
+		case SYS_MMAP:
+			f->R.rax = (uint64_t) mmap((void *) f->R.rdi, f->R.rsi, f->R.rdx,
+					f->R.r10, f->R.r8);
+			break;
+		case SYS_MUNMAP:
+			munmap((void *) f->R.rdi);
+			break;
+		case SYS_MSYNC:
+			f->R.rax = msync((void *) f->R.rdi, f->R.rsi);
+			break;
+		case SYS_SET_RSS_LIMIT:
+			f->R.rax = set_rss_limit(f->R.rdi);
+			break;
+		case SYS_MADVISE:
+			f->R.rax = madvise((void *) f->R.rdi, f->R.rsi, f->R.rdx);
+			break;
+		case SYS_MLOCK:
+			f->R.rax = mlock((void *) f->R.rdi, f->R.rsi);
+			break;
+		case SYS_MUNLOCK:
+			f->R.rax = munlock((void *) f->R.rdi, f->R.rsi);
+			break;
+#endif
 		default:
 			break;
 	}
@@ -188,7 +231,11 @@ int read (int fd, void *buffer, unsigned size){
 	struct file *f = get_file(fd);
 	if(f == NULL) return -1;
 
+#ifdef VM
+	return file_transfer(f, buffer, size, true);
+#else
 	return file_read(f, buffer, size);
+#endif
 }
 int write (int fd, const void *buffer, unsigned size){
 	if(check_fd(fd)) return -1;
@@ -202,7 +249,11 @@ int write (int fd, const void *buffer, unsigned size){
 
 	struct file *f = get_file(fd);
 	if(f == NULL) return -1;
+#ifdef VM
+	return file_transfer(f, (void *) buffer, size, false);
+#else
 	return file_write(f, buffer, size);
+#endif
 }
 void seek (int fd, unsigned position){
 	struct file *f = get_file(fd);
@@ -221,6 +272,95 @@ void close (int fd){
 	thread_current()->fdt[fd] = NULL;
 }
 
+#ifdef VM
+/* WRITABLE also carries the VM_MAP_* flags. */
+void *mmap (void *addr, size_t length, int writable, int fd, off_t offset){
+	if(writable & ~(VM_MAP_WRITE | VM_MAP_ANON | VM_MAP_PRIVATE)) return NULL;
+
+	/* The mapping must be page aligned, non-empty and all in user space. */
+	if(addr == NULL || pg_ofs(addr) != 0) return NULL;
+	if(length == 0 || (uint8_t *) addr + length < (uint8_t *) addr) return NULL;
+	if(!is_user_vaddr(addr) || !is_user_vaddr((uint8_t *) addr + length - 1))
+		return NULL;
+	if(writable & VM_MAP_ANON) {
+		if(writable & VM_MAP_PRIVATE) return NULL;
+		return do_mmap_anon(addr, length, writable & VM_MAP_WRITE);
+	}
+
+	if(check_fd(fd) || fd < 2) return NULL;
+	struct file *f = get_file(fd);
+	if(f == NULL) return NULL;
+	/* The offset must be page aligned and inside the file. */
+	if(offset < 0 || offset % PGSIZE != 0 || offset >= file_length(f))
+		return NULL;
+
+	return do_mmap(addr, length, writable, f, offset);
+}
+void munmap (void *addr){
+	do_munmap(addr);
+}
+int msync (void *addr, size_t length){
+	if(!is_user_vaddr(addr) || !is_user_vaddr((uint8_t *) addr + length - 1)
+			|| (uint8_t *) addr + length < (uint8_t *) addr)
+		return -1;
+	return do_msync(addr, length) ? 0 : -1;
+}
+/* Limits the process to PAGES resident pages, 0 meaning no limit. The
+ * limit survives exec and is inherited by fork. Returns the working-set
+ * estimate, to help size the limit. */
+size_t set_rss_limit (size_t pages){
+	thread_current()->rss_limit = pages;
+	return vm_working_set(thread_current());
+}
+int madvise (void *addr, size_t length, int advice){
+	if(!is_user_vaddr(addr) || !is_user_vaddr((uint8_t *) addr + length - 1)
+			|| (uint8_t *) addr + length < (uint8_t *) addr)
+		return -1;
+	if(advice < VM_ADV_NORMAL || advice > VM_ADV_DONTNEED) return -1;
+	return vm_advise(addr, length, advice) ? 0 : -1;
+}
+int mlock (void *addr, size_t length){
+	if(!is_user_vaddr(addr) || !is_user_vaddr((uint8_t *) addr + length - 1)
+			|| (uint8_t *) addr + length < (uint8_t *) addr)
+		return -1;
+	return vm_lock_range(addr, length) ? 0 : -1;
+}
+int munlock (void *addr, size_t length){
+	if(!is_user_vaddr(addr) || !is_user_vaddr((uint8_t *) addr + length - 1)
+			|| (uint8_t *) addr + length < (uint8_t *) addr)
+		return -1;
+	return vm_unlock_range(addr, length) ? 0 : -1;
+}
+/* Most pages of a user buffer pinned at once by file_transfer(). */
+#define TRANSFER_PAGES VM_PIN_MAX
+/* Reads SIZE bytes from F into BUFFER, if IS_READ, or writes them from
+ * BUFFER to F, TRANSFER_PAGES at a time. The pages of each piece are
+ * pinned for the transfer, so the file system copies without faulting
+ * and eviction cannot take a page it is copying into. */
+static int file_transfer (struct file *f, void *buffer, unsigned size,
+		bool is_read){
+	uint8_t *p = buffer;
+	struct vm_pin pin;
+	int total = 0;
+
+	while(size > 0){
+		unsigned chunk = TRANSFER_PAGES * PGSIZE - pg_ofs(p);
+		if(chunk > size) chunk = size;
+
+		if(!vm_pin_buffer(p, chunk, is_read, &pin)) exit(-1);
+		int n = is_read ? file_read(f, p, chunk) : file_write(f, p, chunk);
+		vm_unpin_buffer(&pin);
+
+		if(n <= 0) break;
+		total += n;
+		if((unsigned) n < chunk) break;
+		p += n;
+		size -= n;
+	}
+	return total;
+}
+#endif
+
 int add_file(struct file* f){
 	for(int fd = 3; fd < maxfd; fd++){
 		if(thread_current()->fdt[fd] == NULL) 
@@ -237,7 +377,13 @@ struct file *get_file(int fd){
 }
 
 void check_ptr(void *ptr){
-	if(ptr == NULL || !is_user_vaddr(ptr) || pml4_get_page(thread_current()->pml4, ptr) == NULL) exit(-1);
+	if(ptr == NULL || !is_user_vaddr(ptr)) exit(-1);
+#ifndef VM
+	if(pml4_get_page(thread_current()->pml4, ptr) == NULL) exit(-1);
+#else
+	/* Pages are loaded lazily, so only the areas can be checked here. */
+	if(!vm_is_mapped(ptr)) exit(-1);
+#endif
 }
 
 bool check_fd(int fd){
@@ -1,13 +1,35 @@
 /* anon.c: Implementation of page for non-disk image (a.k.a. anonymous page). */
 
 #include "vm/vm.h"
+#include <bitmap.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
 #include "devices/disk.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Number of sectors in a swap slot, which holds one page. */
+#define SECTORS_PER_SLOT (PGSIZE / DISK_SECTOR_SIZE)
+
+/* Most pages anon_swap_out_cluster () can write with one command. */
+#define CLUSTER_MAX (DISK_MAX_SECTORS / SECTORS_PER_SLOT)
+
+/* Number of pages in the swap cache, which also bounds the readahead
+ * window. */
+#define SWAP_CACHE_SIZE 16
+
+/* Default readahead window, in pages. */
+#define SWAP_RA_DEFAULT 8
 
 /* DO NOT MODIFY BELOW LINE */
 static struct disk *swap_disk;
 static bool anon_swap_in (struct page *page, void *kva);
 static bool anon_swap_out (struct page *page);
 static void anon_destroy (struct page *page);
+static void anon_shared_release (struct vm_aux *aux);
 
 /* DO NOT MODIFY this struct */
 static const struct page_operations anon_ops = {
@@ -17,36 +39,696 @@ static const struct page_operations anon_ops = {
 	.type = VM_ANON,
 };
 
+/* Swap slot allocator. A set bit in SWAP_MAP marks a slot in use. Runs of
+ * slots are handed out moving forward from SWAP_CURSOR, so pages evicted
+ * one after another land next to each other on the disk. */
+static struct bitmap *swap_map;
+static size_t swap_cursor;
+static struct lock swap_lock;
+
+/* Page whose contents each swap slot holds, or NULL for a free slot or
+ * one that no single page owns, and the number of pages that hold each
+ * slot: more than one for a frame shared copy-on-write when it was
+ * evicted. */
+static struct page **slot_pages;
+static unsigned *slot_refs;
+
+/* Swap cache: copies of slots read ahead of the faults that want them.
+ * Entries are replaced round-robin, except while the disk is still
+ * reading into them, with swap_lock released. A fault on a slot being
+ * read that way waits on SWAP_CACHE_LOADED. Protected by swap_lock. */
+struct swap_cache_entry {
+	size_t slot;           /* Cached slot, or SWAP_SLOT_NONE if unused. */
+	void *kva;             /* The slot's contents. */
+	bool loading;          /* Still being read from disk? */
+};
+static struct swap_cache_entry swap_cache[SWAP_CACHE_SIZE];
+static size_t swap_cache_next;
+static struct condition swap_cache_loaded;
+
+/* Most neighbouring slots read along with a faulting one. */
+static size_t swap_ra_window = SWAP_RA_DEFAULT;
+
+/* Swap-in statistics. */
+static long long swap_cache_hit_cnt;    /* Faults served from the cache. */
+static long long swap_cache_miss_cnt;   /* Faults that read the disk. */
+static long long swap_ra_cnt;           /* Pages read ahead. */
+static long long swap_ra_unused_cnt;    /* ...and dropped without a hit. */
+static long long swap_out_page_cnt;     /* Pages written to the disk. */
+static long long swap_out_write_cnt;    /* ...in this many writes. */
+
 /* Initialize the data for anonymous pages */
 void
 vm_anon_init (void) {
-	/* TODO: Set up the swap_disk. */
-	swap_disk = NULL;
+	size_t slot_cnt;
+	uint8_t *buffers;
+
+	zswap_init ();
+	swap_disk = disk_get (1, 1);
+	lock_init (&swap_lock);
+	cond_init (&swap_cache_loaded);
+	if (swap_disk == NULL)
+		return;
+
+	slot_cnt = disk_size (swap_disk) / SECTORS_PER_SLOT;
+	swap_map = bitmap_create (slot_cnt);
+	slot_pages = calloc (slot_cnt, sizeof *slot_pages);
+	slot_refs = calloc (slot_cnt, sizeof *slot_refs);
+	if (swap_map == NULL || slot_pages == NULL || slot_refs == NULL)
+		PANIC ("swap: out of memory for %zu slots", slot_cnt);
+
+	buffers = palloc_get_multiple (PAL_ASSERT, SWAP_CACHE_SIZE);
+	for (size_t i = 0; i < SWAP_CACHE_SIZE; i++) {
+		swap_cache[i].slot = SWAP_SLOT_NONE;
+		swap_cache[i].kva = buffers + i * PGSIZE;
+		swap_cache[i].loading = false;
+	}
+}
+
+/* Sets the swap-in readahead window to PAGES neighbouring pages, at most
+ * SWAP_CACHE_SIZE. Zero turns readahead off. */
+void
+anon_set_readahead (size_t pages) {
+	swap_ra_window = pages < SWAP_CACHE_SIZE ? pages : SWAP_CACHE_SIZE;
+}
+
+/* Prints swap statistics. */
+void
+anon_print_stats (void) {
+	printf ("Swap: %lld cache hits, %lld misses, %lld pages read ahead "
+			"(%lld unused)\n", swap_cache_hit_cnt, swap_cache_miss_cnt,
+			swap_ra_cnt, swap_ra_unused_cnt);
+	printf ("Swap out: %lld pages in %lld writes\n", swap_out_page_cnt,
+			swap_out_write_cnt);
+	zswap_print_stats ();
 }
 
 /* Initialize the file mapping */
 bool
 anon_initializer (struct page *page, enum vm_type type, void *kva) {
+	/* Fetch first, setting up the anon_page overwrites the uninit_page. */
+	struct anon_shared *shared = type & VM_SHARED ? page->uninit.aux : NULL;
+	struct file_region *origin = type & VM_TEXT ? page->uninit.aux : NULL;
+
 	/* Set up the handler */
 	page->operations = &anon_ops;
 
 	struct anon_page *anon_page = &page->anon;
+	anon_page->slot = SWAP_SLOT_NONE;
+	anon_page->zswap.len = 0;
+	anon_page->shared = shared;
+	if (shared != NULL)
+		vm_aux_get (&shared->aux);
+	anon_page->origin = origin;
+	if (origin != NULL)
+		vm_aux_get (&origin->aux);
+	return true;
+}
+
+/* Turns PAGE, a VM_TEXT page whose frame was just taken away unchanged,
+ * back into an unloaded page that reads itself from its region, or finds
+ * itself in the text page cache, on the next fault. Its reference on the
+ * region passes to the uninit page. */
+void
+anon_text_revert (struct page *page) {
+	struct page old = *page;
+
+	ASSERT (page->frame == NULL && page->next_sharer == NULL);
+	ASSERT (page->anon.origin != NULL && page->anon.shared == NULL);
+
+	anon_discard (page);
+	uninit_new (page, old.va, file_region_load,
+			VM_ANON | VM_AUX_REF | VM_TEXT, &old.anon.origin->aux,
+			anon_initializer);
+	page->owner = old.owner;
+	page->writable = old.writable;
+	page->advice = old.advice;
+	page->locked = old.locked;
+}
+
+/* Creates the backing object of a shared anonymous mapping of PAGE_CNT
+ * pages at UPAGE, all zeros. The caller holds the only reference. Returns
+ * NULL if memory runs out. */
+struct anon_shared *
+anon_shared_create (void *upage, size_t page_cnt) {
+	struct anon_shared *shared;
+
+	ASSERT (pg_ofs (upage) == 0);
+
+	shared = malloc (sizeof *shared + page_cnt * sizeof *shared->pages);
+	if (shared == NULL)
+		return NULL;
+	vm_aux_init (&shared->aux, anon_shared_release);
+	shared->upage = upage;
+	shared->page_cnt = page_cnt;
+	for (size_t i = 0; i < page_cnt; i++) {
+		shared->pages[i].frame = NULL;
+		shared->pages[i].store.slot = SWAP_SLOT_NONE;
+		shared->pages[i].store.zswap.len = 0;
+		shared->pages[i].store.shared = NULL;
+		shared->pages[i].store.origin = NULL;
+	}
+	return shared;
+}
+
+/* Returns the page of SHARED that PAGE maps. */
+static struct anon_shared_page *
+anon_shared_page (struct anon_shared *shared, const struct page *page) {
+	size_t idx = ((uint8_t *) page->va - shared->upage) / PGSIZE;
+
+	ASSERT (idx < shared->page_cnt);
+	return &shared->pages[idx];
+}
+
+/* If PAGE, loaded or not, belongs to a shared anonymous mapping, returns
+ * its page of the mapping's object; otherwise returns NULL. */
+static struct anon_shared_page *
+page_shared_page (struct page *page) {
+	struct anon_shared *shared;
+
+	switch (VM_TYPE (page->operations->type)) {
+		case VM_UNINIT:
+			shared = page->uninit.type & VM_SHARED ? page->uninit.aux : NULL;
+			break;
+		case VM_ANON:
+			shared = page->anon.shared;
+			break;
+		default:
+			return NULL;
+	}
+	return shared != NULL ? anon_shared_page (shared, page) : NULL;
+}
+
+/* If PAGE belongs to a shared anonymous mapping, returns where its object
+ * records the frame holding the page; otherwise returns NULL. */
+struct frame **
+anon_shared_frame (struct page *page) {
+	struct anon_shared_page *p = page_shared_page (page);
+
+	return p != NULL ? &p->frame : NULL;
+}
+
+/* Returns the first of CNT adjacent free swap slots, now marked used and
+ * held once each, or BITMAP_ERROR if there is no such run. */
+static size_t
+swap_alloc (size_t cnt) {
+	size_t slot;
+
+	ASSERT (lock_held_by_current_thread (&swap_lock));
+
+	slot = bitmap_scan_and_flip (swap_map, swap_cursor, cnt, false);
+	if (slot == BITMAP_ERROR)
+		slot = bitmap_scan_and_flip (swap_map, 0, cnt, false);
+	if (slot != BITMAP_ERROR) {
+		swap_cursor = slot + cnt;
+		for (size_t i = 0; i < cnt; i++)
+			slot_refs[slot + i] = 1;
+	}
+	return slot;
+}
+
+/* Returns the swap cache entry holding SLOT, or NULL. */
+static struct swap_cache_entry *
+swap_cache_find (size_t slot) {
+	for (size_t i = 0; i < SWAP_CACHE_SIZE; i++)
+		if (swap_cache[i].slot == slot)
+			return &swap_cache[i];
+	return NULL;
+}
+
+/* Returns the number of swap cache entries that are not being read
+ * into, which swap_cache_claim () may take over. */
+static size_t
+swap_cache_idle_cnt (void) {
+	size_t cnt = 0;
+
+	for (size_t i = 0; i < SWAP_CACHE_SIZE; i++)
+		if (!swap_cache[i].loading)
+			cnt++;
+	return cnt;
+}
+
+/* Takes over the next swap cache entry that is not being read into for
+ * SLOT, marks it loading and returns it. There must be such an entry. */
+static struct swap_cache_entry *
+swap_cache_claim (size_t slot) {
+	struct swap_cache_entry *e;
+
+	do {
+		e = &swap_cache[swap_cache_next];
+		swap_cache_next = (swap_cache_next + 1) % SWAP_CACHE_SIZE;
+	} while (e->loading);
+	if (e->slot != SWAP_SLOT_NONE)
+		swap_ra_unused_cnt++;
+	e->slot = slot;
+	e->loading = true;
+	return e;
+}
+
+/* Drops the hold of PAGE, or of a shared object's store if PAGE is NULL,
+ * on SLOT. The last one marks SLOT free and forgets any cached copy of
+ * it. */
+static void
+swap_slot_release (size_t slot, const struct page *page) {
+	struct swap_cache_entry *e;
+
+	ASSERT (lock_held_by_current_thread (&swap_lock));
+	ASSERT (slot_refs[slot] > 0);
+
+	if (--slot_refs[slot] > 0) {
+		if (slot_pages[slot] == page)
+			slot_pages[slot] = NULL;
+		return;
+	}
+	bitmap_reset (swap_map, slot);
+	slot_pages[slot] = NULL;
+	e = swap_cache_find (slot);
+	if (e != NULL) {
+		e->slot = SWAP_SLOT_NONE;
+		swap_ra_unused_cnt++;
+	}
+}
+
+/* Releases the swap slot of ANON_PAGE, the anon_page of PAGE or, if PAGE
+ * is NULL, a shared object's store, if it has one. */
+static void
+swap_free (struct anon_page *anon_page, const struct page *page) {
+	if (anon_page->slot == SWAP_SLOT_NONE)
+		return;
+	lock_acquire (&swap_lock);
+	swap_slot_release (anon_page->slot, page);
+	lock_release (&swap_lock);
+	anon_page->slot = SWAP_SLOT_NONE;
+}
+
+/* Gives each of the CNT pages in PAGES a swap slot, in runs of adjacent
+ * slots as long as free space allows. Returns false, with no slot taken,
+ * if swap space runs out. */
+static bool
+swap_alloc_cluster (struct page *pages[], size_t cnt) {
+	size_t done = 0, run = cnt;
+	bool success;
+
+	lock_acquire (&swap_lock);
+	while (done < cnt) {
+		size_t slot = swap_alloc (run);
+
+		if (slot == BITMAP_ERROR) {
+			if (run == 1)
+				break;
+			run /= 2;
+			continue;
+		}
+		for (size_t i = 0; i < run; i++) {
+			pages[done + i]->anon.slot = slot + i;
+			slot_pages[slot + i] = pages[done + i];
+		}
+		done += run;
+		if (run > cnt - done)
+			run = cnt - done;
+	}
+	success = done == cnt;
+	if (!success)
+		while (done-- > 0) {
+			swap_slot_release (pages[done]->anon.slot, pages[done]);
+			pages[done]->anon.slot = SWAP_SLOT_NONE;
+		}
+	lock_release (&swap_lock);
+	return success;
+}
+
+/* May SLOT be read ahead on behalf of a fault on PAGE? It must hold a
+ * page of the same process within WINDOW pages of PAGE, and not be cached
+ * already. */
+static bool
+swap_ra_candidate (const struct page *page, size_t slot, size_t window) {
+	const struct page *other;
+	uintptr_t va, other_va, dist;
+
+	if (slot >= bitmap_size (swap_map) || slot_pages[slot] == NULL)
+		return false;
+	other = slot_pages[slot];
+	va = (uintptr_t) page->va;
+	other_va = (uintptr_t) other->va;
+	dist = other_va > va ? other_va - va : va - other_va;
+	return other->owner == page->owner
+		&& dist <= window * PGSIZE
+		&& swap_cache_find (slot) == NULL;
+}
+
+/* Returns the readahead window for a fault on PAGE: none if madvise ()
+ * said the page is accessed at random, the whole swap cache if it said
+ * sequentially, swap_ra_window otherwise. */
+static size_t
+swap_ra_window_of (const struct page *page) {
+	size_t window;
+
+	switch (page->advice) {
+		case VM_ADV_RANDOM:
+			return 0;
+		case VM_ADV_SEQUENTIAL:
+			window = SWAP_CACHE_SIZE;
+			break;
+		default:
+			window = swap_ra_window;
+			break;
+	}
+	return window < CLUSTER_MAX ? window : CLUSTER_MAX - 1;
+}
+
+/* Reads the slot of PAGE, which holds it, into KVA. Runs of adjacent
+ * slots holding nearby pages of the same process, up to the readahead
+ * window of them, come along in the same disk command and land in the
+ * swap cache. Pages swapped out together tend to be used together, so a
+ * later fault on one of them is served without going to disk.
+ * swap_lock is released during the read. The entries read into are
+ * marked loading meanwhile, so that no one reuses them or reads the
+ * same slots again. A slot freed meanwhile has its entry dropped, as
+ * always, and the data read for it is never used. */
+static void
+swap_read_around (const struct page *page, void *kva) {
+	void *sectors[DISK_MAX_SECTORS];
+	struct swap_cache_entry *entries[CLUSTER_MAX];
+	size_t slot = page->anon.slot, lo = slot, hi = slot;
+	size_t window = swap_ra_window_of (page);
+	size_t sector_cnt = 0;
+
+	ASSERT (lock_held_by_current_thread (&swap_lock));
+
+	if (window > swap_cache_idle_cnt ())
+		window = swap_cache_idle_cnt ();
+
+	/* Favour the pages after SLOT, which is how arrays are swept. A
+	 * sequential scan does not come back for the pages before it. */
+	while (hi - lo < window && swap_ra_candidate (page, hi + 1, window))
+		hi++;
+	while (hi - lo < window && lo > 0 && page->advice != VM_ADV_SEQUENTIAL
+			&& swap_ra_candidate (page, lo - 1, window))
+		lo--;
+
+	for (size_t s = lo; s <= hi; s++) {
+		uint8_t *buffer = kva;
+
+		if (s != slot) {
+			entries[s - lo] = swap_cache_claim (s);
+			buffer = entries[s - lo]->kva;
+		}
+		for (size_t i = 0; i < SECTORS_PER_SLOT; i++)
+			sectors[sector_cnt++] = buffer + i * DISK_SECTOR_SIZE;
+	}
+
+	lock_release (&swap_lock);
+	disk_readv (swap_disk, lo * SECTORS_PER_SLOT, sectors, sector_cnt);
+	lock_acquire (&swap_lock);
+
+	for (size_t s = lo; s <= hi; s++)
+		if (s != slot)
+			entries[s - lo]->loading = false;
+	if (hi > lo)
+		cond_broadcast (&swap_cache_loaded, &swap_lock);
+	swap_ra_cnt += hi - lo;
+}
+
+/* Reads the page kept in STORE, a page of a shared object, into KVA and
+ * frees the space it took. Its slot is never read ahead, so it is not in
+ * the swap cache. */
+static void
+anon_store_load (struct anon_page *store, void *kva) {
+	void *sectors[SECTORS_PER_SLOT];
+
+	if (store->zswap.len > 0) {
+		zswap_load (&store->zswap, kva);
+		zswap_free (&store->zswap);
+		return;
+	}
+	if (store->slot == SWAP_SLOT_NONE) {
+		memset (kva, 0, PGSIZE);
+		return;
+	}
+	for (size_t i = 0; i < SECTORS_PER_SLOT; i++)
+		sectors[i] = (uint8_t *) kva + i * DISK_SECTOR_SIZE;
+	disk_readv (swap_disk, store->slot * SECTORS_PER_SLOT, sectors,
+			SECTORS_PER_SLOT);
+	swap_free (store, NULL);
+}
+
+/* Writes the page at KVA to STORE, a page of a shared object: to the
+ * compressed tier if it fits, to a swap slot of its own otherwise. The
+ * slot is not recorded in slot_pages, since no one process's page owns
+ * it. Returns false if swap space runs out. */
+static bool
+anon_store_save (struct anon_page *store, const void *kva) {
+	const void *sectors[SECTORS_PER_SLOT];
+	size_t slot;
+
+	if (zswap_store (kva, &store->zswap))
+		return true;
+	if (swap_map == NULL)
+		return false;
+
+	lock_acquire (&swap_lock);
+	slot = swap_alloc (1);
+	if (slot != BITMAP_ERROR) {
+		swap_out_page_cnt++;
+		swap_out_write_cnt++;
+	}
+	lock_release (&swap_lock);
+	if (slot == BITMAP_ERROR)
+		return false;
+	store->slot = slot;
+	for (size_t i = 0; i < SECTORS_PER_SLOT; i++)
+		sectors[i] = (const uint8_t *) kva + i * DISK_SECTOR_SIZE;
+	disk_writev (swap_disk, slot * SECTORS_PER_SLOT, sectors,
+			SECTORS_PER_SLOT);
+	return true;
+}
+
+/* Writes the page at KVA, the frame of PAGE's page of a shared object,
+ * which no process maps any more, to the object's store, so that the
+ * frame can be freed. Returns false if swap space runs out. */
+bool
+anon_shared_save (struct page *page, const void *kva) {
+	return anon_store_save (&page_shared_page (page)->store, kva);
 }
 
 /* Swap in the page by read contents from the swap disk. */
 static bool
 anon_swap_in (struct page *page, void *kva) {
 	struct anon_page *anon_page = &page->anon;
+	struct swap_cache_entry *e;
+
+	if (anon_page->shared != NULL) {
+		anon_store_load (&anon_shared_page (anon_page->shared, page)->store,
+				kva);
+		return true;
+	}
+
+	if (anon_page->zswap.len > 0) {
+		zswap_load (&anon_page->zswap, kva);
+		zswap_free (&anon_page->zswap);
+		return true;
+	}
+
+	/* Never written out, so never written: still all zeros. */
+	if (anon_page->slot == SWAP_SLOT_NONE) {
+		memset (kva, 0, PGSIZE);
+		return true;
+	}
+
+	lock_acquire (&swap_lock);
+	while ((e = swap_cache_find (anon_page->slot)) != NULL && e->loading)
+		cond_wait (&swap_cache_loaded, &swap_lock);
+	if (e != NULL) {
+		memcpy (kva, e->kva, PGSIZE);
+		e->slot = SWAP_SLOT_NONE;
+		swap_cache_hit_cnt++;
+	} else {
+		swap_read_around (page, kva);
+		swap_cache_miss_cnt++;
+	}
+	swap_slot_release (anon_page->slot, page);
+	anon_page->slot = SWAP_SLOT_NONE;
+	lock_release (&swap_lock);
+	return true;
 }
 
 /* Swap out the page by writing contents to the swap disk. */
 static bool
 anon_swap_out (struct page *page) {
-	struct anon_page *anon_page = &page->anon;
+	struct anon_shared *shared = page->anon.shared;
+
+	if (shared != NULL)
+		return anon_store_save (&anon_shared_page (shared, page)->store,
+				page->frame->kva);
+	return anon_swap_out_cluster (&page, 1);
+}
+
+/* Writes the CNT resident anonymous pages in PAGES, which the caller has
+ * unmapped, to swap. Each is the first of the pages that share its frame,
+ * and the others get its copy too. Pages that fit in the compressed tier
+ * stay in memory; the rest go to disk, in adjacent slots where possible,
+ * and every run of adjacent slots is written with a single disk command
+ * instead of one command per sector. A shared frame always goes to disk,
+ * into one slot that all of its pages hold. Returns false, having written
+ * nothing, if swap space is short. */
+bool
+anon_swap_out_cluster (struct page *all_pages[], size_t cnt) {
+	const void *sectors[DISK_MAX_SECTORS];
+	struct page *pages[CLUSTER_MAX];
+	size_t disk_cnt = 0;
+	size_t write_cnt = 0;
+	size_t i, j;
+
+	ASSERT (cnt > 0 && cnt <= CLUSTER_MAX);
+
+	for (i = 0; i < cnt; i++)
+		if (all_pages[i]->next_sharer != NULL
+				|| !zswap_store (all_pages[i]->frame->kva,
+					&all_pages[i]->anon.zswap))
+			pages[disk_cnt++] = all_pages[i];
+	if (disk_cnt == 0)
+		return true;
+
+	if (swap_map == NULL || !swap_alloc_cluster (pages, disk_cnt)) {
+		for (i = 0; i < cnt; i++)
+			zswap_free (&all_pages[i]->anon.zswap);
+		return false;
+	}
+	cnt = disk_cnt;
+
+	for (i = 0; i < cnt; i = j) {
+		size_t sector_cnt = 0;
+
+		for (j = i; j < cnt; j++) {
+			uint8_t *kva = pages[j]->frame->kva;
+
+			if (j > i && pages[j]->anon.slot != pages[j - 1]->anon.slot + 1)
+				break;
+			for (size_t s = 0; s < SECTORS_PER_SLOT; s++)
+				sectors[sector_cnt++] = kva + s * DISK_SECTOR_SIZE;
+		}
+		disk_writev (swap_disk, pages[i]->anon.slot * SECTORS_PER_SLOT,
+				sectors, sector_cnt);
+		write_cnt++;
+	}
+
+	lock_acquire (&swap_lock);
+	swap_out_page_cnt += cnt;
+	swap_out_write_cnt += write_cnt;
+	for (i = 0; i < cnt; i++)
+		for (struct page *p = pages[i]->next_sharer; p != NULL;
+				p = p->next_sharer) {
+			ASSERT (p->anon.slot == SWAP_SLOT_NONE && p->anon.zswap.len == 0);
+			p->anon.slot = pages[i]->anon.slot;
+			slot_refs[p->anon.slot]++;
+		}
+	lock_release (&swap_lock);
+	return true;
+}
+
+/* Throws away the swapped-out contents of PAGE, whose frame, if any, the
+ * caller has released. PAGE reads back as zeros from now on. A page of a
+ * shared mapping keeps nothing of its own, so this leaves it alone: its
+ * contents belong to every process that maps it. */
+void
+anon_discard (struct page *page) {
+	zswap_free (&page->anon.zswap);
+	swap_free (&page->anon, page);
+}
+
+/* Gives DST, the copy fork () makes of SRC, a private anonymous page that
+ * is not in a frame, what SRC was swapped out to, without reading it
+ * back: a hold on the same swap slot, or a second copy of its compressed
+ * form. Returns false, with DST holding nothing, if the compressed tier
+ * has no room for the copy. */
+bool
+anon_copy_store (struct page *dst, const struct page *src) {
+	ASSERT (src->anon.shared == NULL && src->frame == NULL);
+
+	dst->anon.slot = SWAP_SLOT_NONE;
+	dst->anon.zswap.len = 0;
+	if (src->anon.zswap.len > 0)
+		return zswap_copy (&src->anon.zswap, &dst->anon.zswap);
+	if (src->anon.slot != SWAP_SLOT_NONE) {
+		lock_acquire (&swap_lock);
+		slot_refs[src->anon.slot]++;
+		lock_release (&swap_lock);
+		dst->anon.slot = src->anon.slot;
+	}
+	return true;
 }
 
 /* Destroy the anonymous page. PAGE will be freed by the caller. */
 static void
 anon_destroy (struct page *page) {
-	struct anon_page *anon_page = &page->anon;
+	anon_discard (page);
+	if (page->anon.shared != NULL)
+		vm_aux_put (&page->anon.shared->aux);
+	if (page->anon.origin != NULL)
+		vm_aux_put (&page->anon.origin->aux);
+}
+
+/* Frees the object AUX once no page maps it, along with the frames and
+ * swap space its pages are kept in. */
+static void
+anon_shared_release (struct vm_aux *aux) {
+	struct anon_shared *shared = (struct anon_shared *) aux;
+
+	for (size_t i = 0; i < shared->page_cnt; i++) {
+		struct anon_shared_page *p = &shared->pages[i];
+
+		if (p->frame != NULL) {
+			ASSERT (p->frame->ref_cnt == 0);
+			palloc_free_page (p->frame->kva);
+		}
+		zswap_free (&p->store.zswap);
+		swap_free (&p->store, NULL);
+	}
+	free (shared);
+}
+
+/* Loads a page of a shared anonymous mapping: the vm_initializer of its
+ * pages, which anon_initializer () has tied to their object. */
+bool
+anon_shared_load (struct page *page, void *aux UNUSED) {
+	return anon_swap_in (page, page->frame->kva);
+}
+
+/* Maps LENGTH bytes of zeros at ADDR, shared with the children the process
+ * forks from now on, as mmap () does with MAP_ANONYMOUS. Returns ADDR, or
+ * NULL if the range overlaps a mapping or memory runs out. */
+void *
+do_mmap_anon (void *addr, size_t length, int writable) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	size_t page_cnt = DIV_ROUND_UP (length, PGSIZE);
+	struct anon_shared *shared;
+	struct vma *vma;
+	uint8_t *upage = addr;
+	bool success;
+	size_t i;
+
+	if (vma_overlaps (&spt->vmas, upage, upage + page_cnt * PGSIZE))
+		return NULL;
+
+	shared = anon_shared_create (addr, page_cnt);
+	if (shared == NULL)
+		return NULL;
+	vma = vma_insert (&spt->vmas, upage, upage + page_cnt * PGSIZE,
+			VMA_SHARED, writable, NULL);
+	success = vma != NULL;
+	for (i = 0; success && i < page_cnt; i++) {
+		vm_aux_get (&shared->aux);
+		success = vm_alloc_page_with_initializer (
+				VM_ANON | VM_AUX_REF | VM_SHARED, upage + i * PGSIZE, writable,
+				anon_shared_load, &shared->aux);
+		if (!success)
+			vm_aux_put (&shared->aux);
+	}
+	if (!success && vma != NULL) {
+		for (i--; i-- > 0; )
+			spt_remove_page (spt, spt_find_page (spt, upage + i * PGSIZE));
+		vma_remove (&spt->vmas, vma);
+	}
+	vm_aux_put (&shared->aux);
+	return success ? addr : NULL;
 }
@@ -1,6 +1,20 @@
 /* file.c: Implementation of memory backed file object (mmaped object). */
 
 #include "vm/vm.h"
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* The writeback daemon wakes up this often and writes back up to
+ * WRITEBACK_BATCH dirty pages at a time. */
+#define WRITEBACK_INTERVAL (TIMER_FREQ / 2)
+#define WRITEBACK_BATCH 16
 
 static bool file_backed_swap_in (struct page *page, void *kva);
 static bool file_backed_swap_out (struct page *page);
@@ -14,45 +28,594 @@ static const struct page_operations file_ops = {
 	.type = VM_FILE,
 };
 
+static void file_region_release (struct vm_aux *aux);
+static void file_region_fault_around (struct vm_aux *aux, void *va);
+static void writeback_daemon (void *aux);
+
+/* A dirty page picked by the writeback daemon. */
+struct writeback {
+	struct file_region *region; /* Holds a reference meanwhile. */
+	uint8_t *va;
+	struct page *page;
+	struct frame *frame;
+};
+
+/* Pages are copied here before they are written, so that no frame stays
+ * pinned during the disk I/O. Used by the writeback daemon only. */
+static uint8_t *writeback_buffer;
+
+static long long writeback_page_cnt;    /* Pages written by the daemon. */
+static long long writeback_write_cnt;   /* ...in this many writes. */
+static long long fault_read_cnt;        /* Faults that read pages ahead. */
+static long long fault_map_cnt;         /* Pages they mapped ahead. */
+
 /* The initializer of file vm */
 void
 vm_file_init (void) {
+	writeback_buffer = palloc_get_multiple (PAL_ASSERT, WRITEBACK_BATCH);
+}
+
+/* Starts the writeback daemon. Called once the frame table is set up,
+ * since the daemon walks it. */
+void
+file_writeback_init (void) {
+	if (thread_create ("writebackd", PRI_DEFAULT, writeback_daemon, NULL)
+			== TID_ERROR)
+		PANIC ("cannot start the writeback daemon");
+}
+
+/* Prints writeback statistics. */
+void
+file_print_stats (void) {
+	printf ("Writeback: %lld pages in %lld writes\n", writeback_page_cnt,
+			writeback_write_cnt);
+	printf ("Fault-around: %lld faults read ahead, %lld pages mapped ahead\n",
+			fault_read_cnt, fault_map_cnt);
 }
 
 /* Initialize the file backed page */
 bool
 file_backed_initializer (struct page *page, enum vm_type type, void *kva) {
+	/* Fetch first, setting up the file_page overwrites the uninit_page. */
+	struct file_region *region = page->uninit.aux;
+
+	ASSERT (type & VM_AUX_REF);
+
 	/* Set up the handler */
 	page->operations = &file_ops;
 
 	struct file_page *file_page = &page->file;
+	file_page->region = region;
+	vm_aux_get (&region->aux);
+	return true;
+}
+
+/* Creates a region of PAGE_CNT pages at UPAGE whose first READ_BYTES bytes
+ * are read from FILE at OFS, the rest being zeros. The region keeps its
+ * own handle on FILE. The caller holds the only reference. Returns NULL if
+ * memory runs out. */
+struct file_region *
+file_region_create (struct file *file, off_t ofs, void *upage,
+		size_t page_cnt, size_t read_bytes) {
+	struct file_region *region = malloc (sizeof *region);
+
+	ASSERT (pg_ofs (upage) == 0);
+	ASSERT (ofs % PGSIZE == 0);
+	ASSERT (read_bytes <= page_cnt * PGSIZE);
+
+	if (region == NULL)
+		return NULL;
+	region->file = file_reopen (file);
+	if (region->file == NULL) {
+		free (region);
+		return NULL;
+	}
+	vm_aux_init (&region->aux, file_region_release);
+	region->aux.fault_around = file_region_fault_around;
+	region->ofs = ofs;
+	region->upage = upage;
+	region->page_cnt = page_cnt;
+	region->read_bytes = read_bytes;
+
+	lock_init (&region->lock);
+	return region;
+}
+
+static void
+file_region_release (struct vm_aux *aux) {
+	struct file_region *region = (struct file_region *) aux;
+
+	file_close (region->file);
+	free (region);
+}
+
+/* Returns the number of bytes of the page at VA in REGION that come from
+ * the file. */
+static size_t
+region_read_bytes (const struct file_region *region, const uint8_t *va) {
+	size_t page_ofs = va - region->upage;
+
+	if (page_ofs >= region->read_bytes)
+		return 0;
+	return region->read_bytes - page_ofs < PGSIZE
+		? region->read_bytes - page_ofs : PGSIZE;
+}
+
+/* Reads the CNT pages of REGION starting at VA into BUFFER with a single
+ * file_read_at (). */
+static bool
+region_read (struct file_region *region, uint8_t *va, uint8_t *buffer,
+		size_t cnt) {
+	size_t page_ofs = va - region->upage;
+	size_t bytes = 0;
+
+	if (page_ofs < region->read_bytes) {
+		bytes = region->read_bytes - page_ofs;
+		if (bytes > cnt * PGSIZE)
+			bytes = cnt * PGSIZE;
+	}
+	if (file_read_at (region->file, buffer, bytes, region->ofs + page_ofs)
+			!= (off_t) bytes)
+		return false;
+	memset (buffer + bytes, 0, cnt * PGSIZE - bytes);
+	return true;
+}
+
+/* Is page VA of OWNER still waiting to be loaded from REGION? */
+static bool
+region_page_pending (struct file_region *region, struct thread *owner,
+		uint8_t *va) {
+	struct page *page = spt_find_page (&owner->spt, va);
+
+	return page != NULL && page->frame == NULL
+		&& vm_page_aux (page) == &region->aux;
+}
+
+/* Returns the area of PAGE's owner that maps REGION at PAGE, whose
+ * read-ahead state the owner's SPT lock protects, or NULL. */
+static struct vma *
+region_vma (struct file_region *region, struct page *page) {
+	struct vma *vma = vma_find (&page->owner->spt.vmas, page->va);
+
+	return vma != NULL && vma->region == region ? vma : NULL;
+}
+
+/* Returns how many of the pages after PAGE, about to be loaded, to read
+ * along with it, going by RA. madvise () advice on PAGE overrides the
+ * adaptive window: none for RANDOM, FAULT_AROUND_MAX on every fault for
+ * SEQUENTIAL. */
+static size_t
+region_plan (struct vma_readahead *ra, struct file_region *region,
+		struct page *page) {
+	struct thread *owner = page->owner;
+	uint8_t *va = page->va;
+	size_t cnt = 0;
+
+	if (page->advice == VM_ADV_RANDOM)
+		return 0;
+	if (page->advice == VM_ADV_SEQUENTIAL) {
+		while (cnt < FAULT_AROUND_MAX
+				&& region_page_pending (region, owner, va + (cnt + 1) * PGSIZE))
+			cnt++;
+		return cnt;
+	}
+
+	/* Size the window by how much of the last read-ahead got used. */
+	if (ra->ra_cnt > 0) {
+		size_t used = pml4_collect_range (owner->pml4, ra->ra_start,
+				ra->ra_start + ra->ra_cnt * PGSIZE, PTE_A, false, NULL);
+
+		if (used == ra->ra_cnt && ra->window < FAULT_AROUND_MAX)
+			ra->window *= 2;
+		else if (used * 2 < ra->ra_cnt && ra->window > 1)
+			ra->window /= 2;
+	}
+
+	/* Only a fault where the last one left off looks sequential. */
+	if (va == ra->next_fault)
+		while (cnt < ra->window
+				&& region_page_pending (region, owner, va + (cnt + 1) * PGSIZE))
+			cnt++;
+	return cnt;
+}
+
+/* Fills KVA with the contents of PAGE, a page of REGION. Pages read ahead
+ * by an earlier fault of the same process are copied from its buffer, as
+ * long as the file has not been written since. Otherwise, on a sequential
+ * fault, the pages after PAGE are read in the same file_read_at () and
+ * kept for file_region_fault_around (). */
+static bool
+region_fill (struct file_region *region, struct page *page, void *kva) {
+	struct vma *vma = region_vma (region, page);
+	struct vma_readahead *ra = vma != NULL ? &vma->ra : NULL;
+	uint8_t *va = page->va;
+	uint64_t version;
+	bool success = true;
+
+	/* The region's lock orders the read after any writeback in flight. */
+	lock_acquire (&region->lock);
+	version = inode_version (file_get_inode (region->file));
+	if (ra == NULL) {
+		success = region_read (region, va, kva, 1);
+		lock_release (&region->lock);
+		return success;
+	}
+
+	if (ra->buffer == NULL || ra->buf_version != version
+			|| va < ra->buf_va || va >= ra->buf_va + ra->buf_cnt * PGSIZE) {
+		size_t cnt = 1 + region_plan (ra, region, page);
+		uint8_t *buffer = NULL;
+
+		vma_drop_buffer (vma);
+		if (cnt > 1)
+			buffer = palloc_get_multiple (0, cnt);
+		if (buffer != NULL && region_read (region, va, buffer, cnt)) {
+			ra->buffer = buffer;
+			ra->buf_va = va;
+			ra->buf_cnt = cnt;
+			ra->buf_version = version;
+			fault_read_cnt++;
+		} else {
+			if (buffer != NULL)
+				palloc_free_multiple (buffer, cnt);
+			cnt = 1;
+		}
+		ra->ra_start = va + PGSIZE;
+		ra->ra_cnt = cnt - 1;
+		ra->next_fault = va + cnt * PGSIZE;
+	}
+
+	if (ra->buffer != NULL)
+		memcpy (kva, ra->buffer + (va - ra->buf_va), PGSIZE);
+	else
+		success = region_read (region, va, kva, 1);
+	lock_release (&region->lock);
+	return success;
+}
+
+/* Maps the pages that the fault on VA read ahead, if the fault loaded the
+ * page at VA, and frees the buffer they were read into either way. */
+static void
+file_region_fault_around (struct vm_aux *aux, void *va) {
+	struct file_region *region = (struct file_region *) aux;
+	struct thread *curr = thread_current ();
+	struct vma *vma = vma_find (&curr->spt.vmas, va);
+	struct page *page = spt_find_page (&curr->spt, va);
+	size_t cnt = 0;
+
+	if (vma == NULL || vma->region != region)
+		return;
+	if (page != NULL && page->frame != NULL && vma->ra.buf_va == va)
+		cnt = vma->ra.buf_cnt;
+
+	for (size_t i = 1; i < cnt; i++) {
+		uint8_t *ra_va = (uint8_t *) va + i * PGSIZE;
+
+		if (region_page_pending (region, curr, ra_va) && vm_claim_page (ra_va))
+			fault_map_cnt++;
+	}
+	vma_drop_buffer (vma);
+}
+
+/* Loads a page of the file_region AUX: the vm_initializer of the pages of
+ * a region. */
+bool
+file_region_load (struct page *page, void *aux) {
+	return region_fill (aux, page, page->frame->kva);
 }
 
 /* Swap in the page by read contents from the file. */
 static bool
 file_backed_swap_in (struct page *page, void *kva) {
-	struct file_page *file_page UNUSED = &page->file;
+	struct file_page *file_page = &page->file;
+
+	return region_fill (file_page->region, page, kva);
 }
 
-/* Swap out the page by writeback contents to the file. */
+/* Swap out the page by writeback contents to the file. A frame that
+ * fork () left mapped in several processes is written once, if any of
+ * them wrote to it. */
 static bool
 file_backed_swap_out (struct page *page) {
-	struct file_page *file_page UNUSED = &page->file;
+	struct file_page *file_page = &page->file;
+	struct file_region *region = file_page->region;
+	struct page *p;
+	size_t bytes;
+	bool success = true;
+
+	for (p = page->frame->page; p != NULL; p = p->next_sharer)
+		if (pml4_is_dirty (p->owner->pml4, p->va))
+			break;
+	if (p == NULL)
+		return true;
+
+	/* The region lock orders this write after any the writeback daemon
+	 * has in flight for older contents of the page. Clear first: a write
+	 * by a process still mapping the frame dirties it again. */
+	lock_acquire (&region->lock);
+	for (p = page->frame->page; p != NULL; p = p->next_sharer)
+		pml4_set_dirty (p->owner->pml4, p->va, false);
+	bytes = region_read_bytes (region, page->va);
+	if (file_write_at (region->file, page->frame->kva, bytes,
+				region->ofs + ((uint8_t *) page->va - region->upage))
+			!= (off_t) bytes) {
+		pml4_set_dirty (page->owner->pml4, page->va, true);
+		success = false;
+	}
+	lock_release (&region->lock);
+	return success;
+}
+
+/* Fills BATCH with dirty, privately owned file-backed pages from the frame
+ * table, starting at frame *IDX, and advances *IDX past them. Each entry
+ * holds a reference on its region. Returns the number of entries. */
+static size_t
+writeback_collect (struct writeback batch[], size_t *idx) {
+	size_t cnt = 0;
+
+	vm_frame_lock ();
+	for (; *idx < vm_frame_cnt () && cnt < WRITEBACK_BATCH; (*idx)++) {
+		struct frame *frame = vm_frame_at (*idx);
+		struct page *page = frame->page;
+
+		if (page == NULL || frame->ref_cnt != 1 || frame->busy
+				|| frame->pinned
+				|| VM_TYPE (page->operations->type) != VM_FILE
+				|| page->owner->pml4 == NULL
+				|| !pml4_is_dirty (page->owner->pml4, page->va))
+			continue;
+		batch[cnt].region = page->file.region;
+		batch[cnt].va = page->va;
+		batch[cnt].page = page;
+		batch[cnt].frame = frame;
+		vm_aux_get (&page->file.region->aux);
+		cnt++;
+	}
+	vm_frame_unlock ();
+	return cnt;
+}
+
+/* Orders A before B if it comes first in file order. */
+static bool
+writeback_less (const struct writeback *a, const struct writeback *b) {
+	if (a->region != b->region)
+		return a->region < b->region;
+	return a->va < b->va;
+}
+
+/* Does W's page still hold the page it was picked for, dirty? A busy
+ * frame is left to whoever is writing it out. */
+static bool
+writeback_valid (const struct writeback *w) {
+	struct page *page = w->frame->page;
+
+	return page == w->page && w->page->frame == w->frame && !w->frame->busy
+		&& VM_TYPE (page->operations->type) == VM_FILE
+		&& page->file.region == w->region && page->va == w->va
+		&& pml4_is_dirty (page->owner->pml4, page->va);
+}
+
+/* Writes back the pages of BATCH[0...CNT), which are consecutive pages of
+ * one region, with a single file_write_at (), skipping any page that has
+ * been cleaned, evicted or unmapped since it was picked. */
+static void
+writeback_run (struct writeback batch[], size_t cnt) {
+	struct file_region *region = batch[0].region;
+	uint8_t *start = NULL;
+	size_t bytes = 0;
+
+	/* A region's lock comes before frame_lock, which is never held across
+	 * disk I/O. The copies are taken with both held, and written with
+	 * just the region's. */
+	lock_acquire (&region->lock);
+	vm_frame_lock ();
+	for (size_t i = 0; i < cnt; i++) {
+		struct writeback *w = &batch[i];
+		size_t page_bytes = region_read_bytes (region, w->va);
+
+		if (page_bytes == 0 || !writeback_valid (w)) {
+			if (start != NULL)
+				break;
+			continue;
+		}
+		if (start == NULL)
+			start = w->va;
+		else if (w->va != start + bytes)
+			break;
+		/* Clear first: a write that races with the copy dirties it again. */
+		pml4_set_dirty (w->page->owner->pml4, w->va, false);
+		memcpy (writeback_buffer + (w->va - start), w->frame->kva, page_bytes);
+		bytes += page_bytes;
+		writeback_page_cnt++;
+	}
+	vm_frame_unlock ();
+
+	if (bytes > 0) {
+		file_write_at (region->file, writeback_buffer, bytes,
+				region->ofs + (start - region->upage));
+		writeback_write_cnt++;
+	}
+	lock_release (&region->lock);
+}
+
+/* Writes back the dirty pages of file mappings every WRITEBACK_INTERVAL,
+ * in file order and in as few writes as possible, so that eviction,
+ * munmap () and exit find them clean. */
+static void
+writeback_daemon (void *aux UNUSED) {
+	struct writeback batch[WRITEBACK_BATCH];
+
+	for (;;) {
+		size_t idx = 0, cnt;
+
+		timer_sleep (WRITEBACK_INTERVAL);
+		while ((cnt = writeback_collect (batch, &idx)) > 0) {
+			/* Insertion sort into file order. */
+			for (size_t i = 1; i < cnt; i++) {
+				struct writeback w = batch[i];
+				size_t j;
+
+				for (j = i; j > 0 && writeback_less (&w, &batch[j - 1]); j--)
+					batch[j] = batch[j - 1];
+				batch[j] = w;
+			}
+
+			for (size_t i = 0, j; i < cnt; i = j) {
+				for (j = i + 1; j < cnt; j++)
+					if (batch[j].region != batch[i].region
+							|| batch[j].va != batch[j - 1].va + PGSIZE)
+						break;
+				writeback_run (batch + i, j - i);
+			}
+			for (size_t i = 0; i < cnt; i++)
+				vm_aux_put (&batch[i].region->aux);
+		}
+	}
 }
 
 /* Destory the file backed page. PAGE will be freed by the caller. */
 static void
 file_backed_destroy (struct page *page) {
-	struct file_page *file_page UNUSED = &page->file;
+	struct file_page *file_page = &page->file;
+
+	if (page->frame != NULL)
+		file_backed_swap_out (page);
+	vm_aux_put (&file_page->region->aux);
 }
 
-/* Do the mmap */
+/* Do the mmap. WRITABLE is VM_MAP_WRITE or 0, possibly with
+ * VM_MAP_PRIVATE: then the pages are anonymous pages loaded from the file,
+ * never written back. Those all of whose data comes from the file are
+ * VM_TEXT, and share clean frames with every other process that maps the
+ * same file page until they are written. */
 void *
 do_mmap (void *addr, size_t length, int writable,
 		struct file *file, off_t offset) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	size_t page_cnt = DIV_ROUND_UP (length, PGSIZE);
+	off_t file_len = file_length (file);
+	bool private = writable & VM_MAP_PRIVATE;
+	size_t read_bytes;
+	struct file_region *region;
+	struct vma *vma;
+	uint8_t *upage = addr;
+	bool success = true;
+	size_t i;
+
+	writable &= VM_MAP_WRITE;
+	if (offset < 0 || offset >= file_len)
+		return NULL;
+	read_bytes = (size_t) (file_len - offset) < length
+		? (size_t) (file_len - offset) : length;
+
+	if (vma_overlaps (&spt->vmas, upage, upage + page_cnt * PGSIZE))
+		return NULL;
+
+	region = file_region_create (file, offset, addr, page_cnt, read_bytes);
+	if (region == NULL)
+		return NULL;
+	vma = vma_insert (&spt->vmas, upage, upage + page_cnt * PGSIZE, VMA_MMAP,
+			writable, region);
+	success = vma != NULL;
+	for (i = 0; success && i < page_cnt; i++) {
+		enum vm_type type = VM_FILE | VM_AUX_REF;
+
+		if (private)
+			type = VM_ANON | VM_AUX_REF
+				| ((i + 1) * PGSIZE <= read_bytes ? VM_TEXT : 0);
+		vm_aux_get (&region->aux);
+		success = vm_alloc_page_with_initializer (type, upage + i * PGSIZE,
+				writable, file_region_load, &region->aux);
+		if (!success)
+			vm_aux_put (&region->aux);
+	}
+	if (!success && vma != NULL) {
+		for (i--; i-- > 0; )
+			spt_remove_page (spt, spt_find_page (spt, upage + i * PGSIZE));
+		vma_remove (&spt->vmas, vma);
+	}
+	vm_aux_put (&region->aux);
+	return success ? addr : NULL;
 }
 
-/* Do the munmap */
+/* Writes back the dirty pages of the file mappings in the LENGTH bytes at
+ * ADDR, which must be page aligned, right away. Returns false if part of
+ * the range is not mapped or a write fails. */
+bool
+do_msync (void *addr, size_t length) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	uint8_t *upage = addr;
+	bool success = true;
+
+	if (pg_ofs (addr) != 0)
+		return false;
+	/* Keeps the pages from being freed, or loaded as some other type,
+	 * while they are written. */
+	lock_acquire (&spt->lock);
+	for (size_t i = 0; i < DIV_ROUND_UP (length, PGSIZE); i++) {
+		struct page *page = spt_find_page (spt, upage + i * PGSIZE);
+
+		if (page == NULL) {
+			success = false;
+			continue;
+		}
+		if (VM_TYPE (page->operations->type) != VM_FILE)
+			continue;
+
+		if (!vm_write_back (page))
+			success = false;
+	}
+	lock_release (&spt->lock);
+	return success;
+}
+
+/* Do the munmap: of a file mapping or of shared anonymous memory. */
 void
 do_munmap (void *addr) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct file_region *region;
+	struct tlb_gather tlb;
+	struct page *page;
+	struct vma *vma;
+	uint8_t *start, *end;
+
+	lock_acquire (&spt->lock);
+	vma = vma_find (&spt->vmas, addr);
+	if (vma == NULL || (vma->type != VMA_MMAP && vma->type != VMA_SHARED)
+			|| vma->start != addr) {
+		lock_release (&spt->lock);
+		return;
+	}
+	start = vma->start;
+	end = vma->end;
+	region = vma->region;
+
+	/* Each page holds a reference, so keep the region alive meanwhile. */
+	if (region != NULL)
+		vm_aux_get (&region->aux);
+
+	/* Unmap the whole area first and flush the TLB once for it. The
+	 * dirty bits stay, for the write-back as each page goes. */
+	vm_frame_lock ();
+	tlb_gather_init (&tlb, thread_current ()->pml4);
+	pml4_clear_range (thread_current ()->pml4, start, end, &tlb);
+	tlb_gather_finish (&tlb);
+	vm_frame_unlock ();
+
+	/* Every page in the area belongs to the mapping. */
+	for (uint8_t *va = start; va < end; va += PGSIZE) {
+		page = spt_find_page (spt, va);
+		if (page != NULL)
+			spt_remove_page (spt, page);
+	}
+
+	/* The pages are gone for good, and so are their page tables. reclaimd
+	 * frees page tables too, under frame_lock. */
+	vm_frame_lock ();
+	pml4_remove_range (thread_current ()->pml4, start, end);
+	vm_frame_unlock ();
+	vma_remove (&spt->vmas, vma);
+	lock_release (&spt->lock);
+	if (region != NULL)
+		vm_aux_put (&region->aux);
 }
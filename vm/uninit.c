@@ -8,6 +8,8 @@
  * function.
  * */
 
+#include <string.h>
+#include "threads/vaddr.h"
 #include "vm/vm.h"
 #include "vm/uninit.h"
 
@@ -50,10 +52,35 @@ uninit_initialize (struct page *page, void *kva) {
 	/* Fetch first, page_initialize may overwrite the values */
 	vm_initializer *init = uninit->init;
 	void *aux = uninit->aux;
+	enum vm_type type = uninit->type;
+	bool success;
 
-	/* TODO: You may need to fix this function. */
-	return uninit->page_initializer (page, uninit->type, kva) &&
+	/* A page without an initializer starts out zero-filled. */
+	if (init == NULL)
+		memset (kva, 0, PGSIZE);
+
+	success = uninit->page_initializer (page, type, kva) &&
 		(init ? init (page, aux) : true);
+
+	/* The page no longer needs its share of AUX. */
+	if (type & VM_AUX_REF)
+		vm_aux_put (aux);
+	return success;
+}
+
+/* Turns PAGE into a page of its final type without running its
+ * initializer, for a page whose contents are already in place at KVA. */
+bool
+uninit_transmute (struct page *page, void *kva) {
+	struct uninit_page *uninit = &page->uninit;
+	void *aux = uninit->aux;
+	enum vm_type type = uninit->type;
+
+	if (!uninit->page_initializer (page, type, kva))
+		return false;
+	if (type & VM_AUX_REF)
+		vm_aux_put (aux);
+	return true;
 }
 
 /* Free the resources hold by uninit_page. Although most of pages are transmuted
@@ -62,7 +89,8 @@ uninit_initialize (struct page *page, void *kva) {
  * PAGE will be freed by the caller. */
 static void
 uninit_destroy (struct page *page) {
-	struct uninit_page *uninit UNUSED = &page->uninit;
-	/* TODO: Fill this function.
-	 * TODO: If you don't have anything to do, just return. */
+	struct uninit_page *uninit = &page->uninit;
+
+	if (uninit->type & VM_AUX_REF)
+		vm_aux_put (uninit->aux);
 }
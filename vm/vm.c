@@ -1,9 +1,189 @@
 /* vm.c: Generic interface for virtual memory objects. */
 
+#include <hash.h>
+#include <list.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/inode.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
 #include "vm/vm.h"
 #include "vm/inspect.h"
 
+/* Maximum size of the user stack. */
+
+/* Leaf of the supplemental page table: one kernel page of pointers to the
+ * pages of one 2 MB region, indexed by PTX (), NULL where there is none.
+ * The lowest directory links to it with the address of the leaf, which is
+ * page aligned, ORed with the number of pages in it, much like a PDE
+ * carries its flags, so that removing a page tells in constant time
+ * whether the leaf has become empty. */
+struct spt_leaf {
+	struct page *pages[SPT_ENTRY_CNT];
+};
+
+/* A slot for one struct page, or a link in its slab's free list. */
+union page_slot {
+	struct page page;
+	union page_slot *next;
+};
+
+/* Slab of struct pages: one kernel page, this header followed by
+ * PAGE_SLAB_CNT slots, all of them pages of one SPT. */
+struct page_slab {
+	struct list_elem elem;            /* In the SPT's slabs while not full. */
+	union page_slot *free;            /* Free slots. */
+	size_t used_cnt;                  /* Slots in use. */
+	union page_slot slots[];
+};
+
+#define PAGE_SLAB_CNT \
+	((PGSIZE - sizeof (struct page_slab)) / sizeof (union page_slot))
+
+/* Depth of the directory levels above the leaves (PML4, PDPE, PDX). */
+#define SPT_DIR_LEVELS 3
+
+/* Most anonymous pages written out to swap by one eviction. */
+#define EVICT_CLUSTER 8
+
+/* Pages not referenced for this many ticks have left the working set, as
+ * far as WSClock is concerned. */
+#define WSCLOCK_TAU (TIMER_FREQ / 2)
+
+/* Ticks between two passes of the working-set sampler. */
+#define WS_SAMPLE_INTERVAL TIMER_FREQ
+
+/* A fault in a SEQUENTIAL range leaves the SEQ_KEEP_BEHIND pages behind it
+ * alone and ages up to SEQ_AGE_CNT pages further back. */
+#define SEQ_KEEP_BEHIND 8
+#define SEQ_AGE_CNT 16
+
+typedef bool spt_for_each_func (struct page *, void *aux);
+
+/* Frame table: one entry per user pool page. */
+static struct frame *frame_table;
+static size_t frame_cnt;
+static uint8_t *frame_base;         /* Kernel address of the first frame. */
+static struct lock frame_lock;      /* Protects the table and its hand. */
+
+/* Signalled with frame_lock when a busy frame goes idle. frame_lock is
+ * never held across disk I/O: a frame being filled or written out is
+ * marked busy instead, the lock is released for the transfer, and anyone
+ * who needs the frame meanwhile waits here and looks again. */
+static struct condition frame_idle;
+static size_t clock_hand;           /* Next frame the clock looks at. */
+
+/* A page of zeros, mapped read-only for every zero-fill page that has been
+ * read but not yet written. It lives outside the user pool and the frame
+ * table, so it is never evicted, and its sharers are not tracked. */
+static struct frame zero_frame;
+
+/* Text page cache: frames holding clean VM_TEXT pages, read-only
+ * executable pages and pages of private file mappings, found by their
+ * place in the file, so that processes running the same program or
+ * mapping the same file share them. A write to the file changes its
+ * version, so that later faults do not find the old contents. An entry
+ * lives as long as its frame holds the page and no one has written to
+ * it. Protected by frame_lock. */
+struct text_page {
+	struct hash_elem elem;
+	struct inode *inode;
+	uint64_t version;           /* inode_version () when it was read. */
+	off_t ofs;
+	struct frame *frame;
+};
+static struct hash text_pages;
+static long long text_load_cnt;     /* Text pages read from the file. */
+static long long text_share_cnt;    /* Text pages mapped from the cache. */
+static long long text_drop_cnt;     /* Text pages evicted without I/O. */
+
+static long long huge_page_cnt;     /* 2 MB blocks mapped by one PDE. */
+
+/* Pages of shared anonymous mappings found in memory by a fault, evicted
+ * for all of the processes mapping them at once, and saved to their
+ * object's store when the last process let go of them. */
+static long long shared_join_cnt;
+static long long shared_evict_cnt;
+static long long shared_save_cnt;
+
+/* Pages fork () gave the child without bringing them into memory or
+ * writing them back: swapped-out anonymous pages, whose swap space the
+ * child shares, and file-backed pages, whose frame it maps too. */
+static long long fork_swap_cnt;
+static long long fork_file_cnt;
+
+/* With pt_discard, the page table that maps a page just evicted is freed
+ * once none of the pages it covers is resident, and rebuilt from the SPT
+ * by the next fault there. */
+static bool pt_discard;
+static long long pt_discard_cnt;    /* Page tables freed that way. */
+
+/* Background reclaim. Once a frame allocation leaves fewer than
+ * reclaim_low frames free, reclaimd evicts pages until reclaim_high are,
+ * so that faulting threads find a free frame without evicting one
+ * themselves. */
+static struct semaphore reclaim_sema;
+static bool reclaim_pending;        /* Woken and not done yet. Protected by
+                                       frame_lock. */
+static size_t reclaim_low, reclaim_high;
+static long long reclaim_bg_cnt;    /* Frames freed by reclaimd. */
+static long long reclaim_fg_cnt;    /* Frames evicted by faulting threads. */
+static bool reclaim_ready;          /* reclaimd is running. */
+
+/* Working-set sampler. Every WS_SAMPLE_INTERVAL ticks, reclaimd counts the
+ * pages each process referenced since the last pass and clears their
+ * accessed bits, remembering them in frame->referenced for the clock. */
+static bool ws_sample_due;
+static unsigned ws_gen;             /* Number of the last pass. */
+static unsigned ws_ticks;           /* Ticks since the last pass. */
+
+static long long rss_evict_cnt;     /* Frames evicted to enforce budgets. */
+
+/* Pages locked by mlock (), and the most there may be, which keeps half
+ * of the user pool evictable. Protected by frame_lock. */
+static size_t locked_cnt;
+static size_t locked_max;
+static long long buffer_pin_cnt;    /* Buffer pages pinned by syscalls. */
+
+/* madvise () statistics. */
+static long long advise_load_cnt;   /* Pages loaded for WILLNEED. */
+static long long advise_drop_cnt;   /* Pages dropped for DONTNEED. */
+static long long advise_age_cnt;    /* Pages aged behind SEQUENTIAL scans. */
+
+/* Kernel same-page merging. Every KSM_INTERVAL ticks, ksmd looks at the
+ * next ksm_rate frames. A frame that holds one anonymous page, and whose
+ * contents have not changed since its last visit, is merged with another
+ * frame of the same contents, found through ksm_table by checksum, or
+ * with zero_frame if it is all zeros. The merged page is mapped
+ * read-only, so the first write copies it back out in vm_handle_wp ().
+ * Protected by frame_lock. */
+#define KSM_INTERVAL 20
+#define KSM_TABLE_SIZE 512
+
+struct ksm_slot {
+	struct frame *frame;        /* Last frame seen with SUM, if any. */
+	unsigned sum;
+};
+static struct ksm_slot ksm_table[KSM_TABLE_SIZE];
+static size_t ksm_rate;             /* 0 disables ksmd. */
+static size_t ksm_hand;             /* Next frame ksmd looks at. */
+static unsigned ksm_zero_sum;       /* Checksum of a page of zeros. */
+static long long ksm_scan_cnt;      /* Frames checksummed. */
+static long long ksm_merge_cnt;     /* Pages merged into another frame. */
+static long long ksm_zero_cnt;      /* Pages merged into zero_frame. */
+
+static enum vm_evict_policy evict_policy = EVICT_CLOCK;
+
+static void frame_table_init (void);
+static void reclaim_init (void);
+static void ksm_init (void);
+static bool frame_share (struct frame *frame, struct page *page);
+
 /* Initializes the virtual memory subsystem by invoking each subsystem's
  * intialize codes. */
 void
@@ -15,7 +195,65 @@ vm_init (void) {
 #endif
 	register_inspect_intr ();
 	/* DO NOT MODIFY UPPER LINES. */
-	/* TODO: Your code goes here. */
+	frame_table_init ();
+	file_writeback_init ();
+	reclaim_init ();
+	ksm_init ();
+}
+
+/* Prints virtual memory statistics. */
+void
+vm_print_stats (void) {
+	printf ("Text pages: %lld loaded, %lld shared, %lld dropped\n",
+			text_load_cnt, text_share_cnt, text_drop_cnt);
+	printf ("Huge pages: %lld mapped\n", huge_page_cnt);
+	printf ("Shared memory: %lld pages found in memory, %lld evicted, "
+			"%lld saved\n", shared_join_cnt, shared_evict_cnt, shared_save_cnt);
+	printf ("Fork: %lld swapped pages and %lld file pages shared\n",
+			fork_swap_cnt, fork_file_cnt);
+	printf ("Page tables: %lld discarded\n", pt_discard_cnt);
+	file_print_stats ();
+	printf ("Reclaim: %lld frames freed in the background, "
+			"%lld evicted on fault, %lld to keep processes in budget\n",
+			reclaim_bg_cnt, reclaim_fg_cnt, rss_evict_cnt);
+	printf ("Advice: %lld pages loaded, %lld dropped, %lld aged\n",
+			advise_load_cnt, advise_drop_cnt, advise_age_cnt);
+	printf ("Locked: %zu pages locked (at most %zu), %lld buffer pages "
+			"pinned\n", locked_cnt, locked_max, buffer_pin_cnt);
+	printf ("KSM: %lld frames scanned, %lld pages merged, %lld into the "
+			"zero page\n", ksm_scan_cnt, ksm_merge_cnt, ksm_zero_cnt);
+	anon_print_stats ();
+}
+
+/* Selects the eviction policy called NAME: "clock", "eclock" or
+ * "wsclock". Returns false if there is no such policy. */
+bool
+vm_set_evict_policy (const char *name) {
+	if (name == NULL)
+		return false;
+	else if (!strcmp (name, "clock"))
+		evict_policy = EVICT_CLOCK;
+	else if (!strcmp (name, "eclock"))
+		evict_policy = EVICT_ECLOCK;
+	else if (!strcmp (name, "wsclock"))
+		evict_policy = EVICT_WSCLOCK;
+	else
+		return false;
+	return true;
+}
+
+/* Makes ksmd look at FRAMES frames every KSM_INTERVAL ticks. Must be
+ * called before vm_init (). */
+void
+vm_set_ksm_rate (size_t frames) {
+	ksm_rate = frames;
+}
+
+/* Makes eviction free the page tables of regions it leaves with no page
+ * in memory. */
+void
+vm_set_pt_discard (bool discard) {
+	pt_discard = discard;
 }
 
 /* Get the type of the page. This function is useful if you want to know the
@@ -33,9 +271,16 @@ page_get_type (struct page *page) {
 }
 
 /* Helpers */
-static struct frame *vm_get_victim (void);
+static struct frame *vm_get_victim (struct thread *owner);
 static bool vm_do_claim_page (struct page *page);
-static struct frame *vm_evict_frame (void);
+static struct frame *vm_evict_frame (struct thread *owner);
+static bool frame_claim (struct page *page);
+static bool vm_do_handle_fault (struct intr_frame *f, void *addr, bool user,
+		bool write, bool not_present);
+static void vm_free_frame (struct page *page);
+static struct page *spt_reserve (struct supplemental_page_table *spt,
+		void *va);
+static void spt_clear (struct supplemental_page_table *spt);
 
 /* Create the pending page object with initializer. If you want to create a
  * page, do not create it directly and make it through this function or
@@ -47,144 +292,2163 @@ vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 	ASSERT (VM_TYPE(type) != VM_UNINIT)
 
 	struct supplemental_page_table *spt = &thread_current ()->spt;
+	bool (*initializer) (struct page *, enum vm_type, void *);
+	struct page *page;
+
+	switch (VM_TYPE (type)) {
+		case VM_ANON:
+			initializer = anon_initializer;
+			break;
+		case VM_FILE:
+			initializer = file_backed_initializer;
+			break;
+		default:
+			goto err;
+	}
 
 	/* Check wheter the upage is already occupied or not. */
 	if (spt_find_page (spt, upage) == NULL) {
-		/* TODO: Create the page, fetch the initialier according to the VM type,
-		 * TODO: and then create "uninit" page struct by calling uninit_new. You
-		 * TODO: should modify the field after calling the uninit_new. */
+		page = spt_reserve (spt, upage);
+		if (page == NULL)
+			goto err;
 
-		/* TODO: Insert the page into the spt. */
+		uninit_new (page, upage, init, type, aux, initializer);
+		page->owner = thread_current ();
+		page->writable = writable;
+		return true;
 	}
 err:
 	return false;
 }
 
+/* Returns the leaf that a link from the lowest directory points to, or
+ * NULL. */
+static struct spt_leaf *
+spt_link_leaf (uintptr_t link) {
+	return (struct spt_leaf *) (link & ~(uintptr_t) PGMASK);
+}
+
+/* Returns the number of pages in the leaf that LINK points to. */
+static size_t
+spt_link_cnt (uintptr_t link) {
+	return link & PGMASK;
+}
+
+/* Returns the link in SPT's directories that points to the leaf covering VA.
+ * Missing directories are allocated if CREATE is true; otherwise, or if the
+ * allocation fails, returns NULL. */
+static uintptr_t *
+spt_leaf_link (struct supplemental_page_table *spt, const void *va,
+		bool create) {
+	const size_t idx[SPT_DIR_LEVELS] = { PML4 (va), PDPE (va), PDX (va) };
+	void **link = (void **) &spt->root;
+
+	for (int level = 0; level < SPT_DIR_LEVELS; level++) {
+		if (*link == NULL) {
+			if (!create)
+				return NULL;
+			*link = palloc_get_page (PAL_ZERO);
+			if (*link == NULL)
+				return NULL;
+		}
+		link = &((void **) *link)[idx[level]];
+	}
+	return (uintptr_t *) link;
+}
+
+/* Returns the leaf of SPT that covers VA, or NULL if there is none. */
+static struct spt_leaf *
+spt_find_leaf (struct supplemental_page_table *spt, const void *va) {
+	uintptr_t *link = spt_leaf_link (spt, va, false);
+
+	return link != NULL ? spt_link_leaf (*link) : NULL;
+}
+
+/* Returns a zeroed struct page from one of SPT's slabs, or NULL if memory
+ * runs out. */
+static struct page *
+page_slot_alloc (struct supplemental_page_table *spt) {
+	struct page_slab *slab;
+	union page_slot *slot;
+
+	if (list_empty (&spt->slabs)) {
+		slab = palloc_get_page (0);
+		if (slab == NULL)
+			return NULL;
+		slab->free = NULL;
+		slab->used_cnt = 0;
+		for (size_t i = PAGE_SLAB_CNT; i-- > 0; ) {
+			slab->slots[i].next = slab->free;
+			slab->free = &slab->slots[i];
+		}
+		list_push_front (&spt->slabs, &slab->elem);
+	}
+	slab = list_entry (list_front (&spt->slabs), struct page_slab, elem);
+	slot = slab->free;
+	slab->free = slot->next;
+	if (++slab->used_cnt == PAGE_SLAB_CNT)
+		list_remove (&slab->elem);
+
+	memset (&slot->page, 0, sizeof slot->page);
+	return &slot->page;
+}
+
+/* Returns PAGE's slot to its slab in SPT, and the slab to the kernel pool
+ * once none of its slots is in use. */
+static void
+page_slot_free (struct supplemental_page_table *spt, struct page *page) {
+	union page_slot *slot = (union page_slot *) page;
+	struct page_slab *slab = pg_round_down (page);
+
+	if (slab->used_cnt == PAGE_SLAB_CNT)
+		list_push_front (&spt->slabs, &slab->elem);
+	slot->next = slab->free;
+	slab->free = slot;
+	if (--slab->used_cnt == 0) {
+		list_remove (&slab->elem);
+		palloc_free_page (slab);
+	}
+}
+
+/* Takes the empty slot for page VA in SPT and returns the page in it.
+ * Returns NULL if the slot is already occupied or the table cannot
+ * grow. */
+static struct page *
+spt_reserve (struct supplemental_page_table *spt, void *va) {
+	uintptr_t *link = spt_leaf_link (spt, va, true);
+	struct spt_leaf *leaf;
+	struct page *page;
+
+	if (link == NULL)
+		return NULL;
+	if (*link == 0) {
+		leaf = palloc_get_page (PAL_ZERO);
+		if (leaf == NULL)
+			return NULL;
+		*link = (uintptr_t) leaf;
+	}
+
+	leaf = spt_link_leaf (*link);
+	if (leaf->pages[PTX (va)] != NULL)
+		return NULL;
+	page = page_slot_alloc (spt);
+	if (page == NULL) {
+		/* Do not leave a leaf just allocated for nothing behind. */
+		if (spt_link_cnt (*link) == 0) {
+			palloc_free_page (leaf);
+			*link = 0;
+		}
+		return NULL;
+	}
+	leaf->pages[PTX (va)] = page;
+	(*link)++;
+	spt->page_cnt++;
+	page->va = pg_round_down (va);
+	return page;
+}
+
 /* Find VA from spt and return page. On error, return NULL. */
 struct page *
-spt_find_page (struct supplemental_page_table *spt UNUSED, void *va UNUSED) {
-	struct page *page = NULL;
-	/* TODO: Fill this function. */
+spt_find_page (struct supplemental_page_table *spt, void *va) {
+	struct spt_leaf *leaf = spt_find_leaf (spt, va);
 
-	return page;
+	return leaf != NULL ? leaf->pages[PTX (va)] : NULL;
 }
 
-/* Insert PAGE into spt with validation. */
+/* Insert PAGE into spt with validation. PAGE is copied into a slot of the
+ * table's own; look the page up again with spt_find_page () to get the
+ * copy that lives in SPT. */
 bool
-spt_insert_page (struct supplemental_page_table *spt UNUSED,
-		struct page *page UNUSED) {
-	int succ = false;
-	/* TODO: Fill this function. */
+spt_insert_page (struct supplemental_page_table *spt, struct page *page) {
+	struct page *slot;
 
-	return succ;
+	ASSERT (page->operations != NULL);
+
+	slot = spt_reserve (spt, page->va);
+	if (slot == NULL)
+		return false;
+	*slot = *page;
+	return true;
 }
 
 void
 spt_remove_page (struct supplemental_page_table *spt, struct page *page) {
+	uintptr_t *link = spt_leaf_link (spt, page->va, false);
+	struct spt_leaf *leaf;
+
+	ASSERT (link != NULL && spt_link_cnt (*link) > 0);
+	leaf = spt_link_leaf (*link);
+	ASSERT (leaf->pages[PTX (page->va)] == page);
+
+	leaf->pages[PTX (page->va)] = NULL;
 	vm_dealloc_page (page);
+	page_slot_free (spt, page);
+	spt->page_cnt--;
+	if (spt_link_cnt (--*link) == 0) {
+		palloc_free_page (leaf);
+		*link = 0;
+	}
+}
+
+/* Calls FUNC on every page in the subtree DIR at directory LEVEL, stopping
+ * early if FUNC returns false. */
+static bool
+spt_dir_for_each (void **dir, int level, spt_for_each_func *func,
+		void *aux) {
+	for (size_t i = 0; i < SPT_ENTRY_CNT; i++) {
+		if (dir[i] == NULL)
+			continue;
+
+		if (level + 1 < SPT_DIR_LEVELS) {
+			if (!spt_dir_for_each (dir[i], level + 1, func, aux))
+				return false;
+		} else {
+			struct spt_leaf *leaf = spt_link_leaf ((uintptr_t) dir[i]);
+			for (size_t j = 0; j < SPT_ENTRY_CNT; j++)
+				if (leaf->pages[j] != NULL && !func (leaf->pages[j], aux))
+					return false;
+		}
+	}
+	return true;
+}
+
+/* Apply FUNC to each page in SPT. Returns false as soon as FUNC does. */
+static bool
+spt_for_each (struct supplemental_page_table *spt, spt_for_each_func *func,
+		void *aux) {
+	return spt->root == NULL
+		|| spt_dir_for_each (spt->root, 0, func, aux);
+}
+
+/* Frees LEAF of SPT and the slots of its pages, which must be
+ * deallocated. */
+static void
+spt_leaf_destroy (struct supplemental_page_table *spt,
+		struct spt_leaf *leaf) {
+	for (size_t i = 0; i < SPT_ENTRY_CNT; i++)
+		if (leaf->pages[i] != NULL)
+			page_slot_free (spt, leaf->pages[i]);
+	palloc_free_page (leaf);
+}
+
+/* Frees directory DIR of SPT at LEVEL along with every directory and leaf
+ * below. */
+static void
+spt_dir_destroy (struct supplemental_page_table *spt, void **dir,
+		int level) {
+	for (size_t i = 0; i < SPT_ENTRY_CNT; i++) {
+		if (dir[i] == NULL)
+			continue;
+		if (level + 1 < SPT_DIR_LEVELS)
+			spt_dir_destroy (spt, dir[i], level + 1);
+		else
+			spt_leaf_destroy (spt, spt_link_leaf ((uintptr_t) dir[i]));
+	}
+	palloc_free_page (dir);
+}
+
+/* Initializes the reference count of AUX to one, owned by the caller.
+ * RELEASE is called when the last reference goes away. */
+void
+vm_aux_init (struct vm_aux *aux, void (*release) (struct vm_aux *)) {
+	aux->ref_cnt = 1;
+	aux->release = release;
+	aux->fault_around = NULL;
+}
+
+/* Takes another reference on AUX and returns it. */
+struct vm_aux *
+vm_aux_get (struct vm_aux *aux) {
+	enum intr_level old_level = intr_disable ();
+	aux->ref_cnt++;
+	intr_set_level (old_level);
+	return aux;
+}
+
+/* Drops a reference on AUX, releasing it with the last one. */
+void
+vm_aux_put (struct vm_aux *aux) {
+	enum intr_level old_level = intr_disable ();
+	bool last = --aux->ref_cnt == 0;
+	intr_set_level (old_level);
+
+	if (last)
+		aux->release (aux);
+}
+
+/* Returns the aux PAGE is loaded from, or NULL: the initializer's aux of
+ * an uninit page, or the region of a file-backed page. */
+struct vm_aux *
+vm_page_aux (struct page *page) {
+	switch (VM_TYPE (page->operations->type)) {
+		case VM_UNINIT:
+			return page->uninit.type & VM_AUX_REF ? page->uninit.aux : NULL;
+		case VM_FILE:
+			return &page->file.region->aux;
+		default:
+			return NULL;
+	}
+}
+
+static uint64_t
+text_page_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct text_page *t = hash_entry (e, struct text_page, elem);
+
+	return hash_bytes (&t->inode, sizeof t->inode)
+		^ hash_bytes (&t->version, sizeof t->version) ^ hash_int (t->ofs);
+}
+
+static bool
+text_page_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct text_page *a = hash_entry (a_, struct text_page, elem);
+	const struct text_page *b = hash_entry (b_, struct text_page, elem);
+
+	if (a->inode != b->inode)
+		return a->inode < b->inode;
+	if (a->version != b->version)
+		return a->version < b->version;
+	return a->ofs < b->ofs;
+}
+
+/* Is PAGE an unloaded VM_TEXT page? */
+static bool
+page_is_text (const struct page *page) {
+	return VM_TYPE (page->operations->type) == VM_UNINIT
+		&& (page->uninit.type & VM_TEXT);
+}
+
+/* If PAGE is an unloaded VM_TEXT page, stores where in the file it comes
+ * from into KEY and returns true. */
+static bool
+text_page_key (struct page *page, struct text_page *key) {
+	struct file_region *region;
+
+	if (!page_is_text (page))
+		return false;
+	region = page->uninit.aux;
+	key->inode = file_get_inode (region->file);
+	key->version = inode_version (key->inode);
+	key->ofs = region->ofs + ((uint8_t *) page->va - region->upage);
 	return true;
 }
 
-/* Get the struct frame, that will be evicted. */
+/* Returns the frame that holds the text page KEY, or NULL. */
 static struct frame *
-vm_get_victim (void) {
-	struct frame *victim = NULL;
-	 /* TODO: The policy for eviction is up to you. */
+text_page_lookup (struct text_page *key) {
+	struct hash_elem *e = hash_find (&text_pages, &key->elem);
 
-	return victim;
+	return e != NULL ? hash_entry (e, struct text_page, elem)->frame : NULL;
+}
+
+/* Records that FRAME holds the text page KEY. Sharing is an optimization,
+ * so running out of memory here is not an error. */
+static void
+text_page_remember (struct frame *frame, const struct text_page *key) {
+	struct text_page *t = malloc (sizeof *t);
+
+	if (t == NULL)
+		return;
+	*t = *key;
+	t->frame = frame;
+	hash_insert (&text_pages, &t->elem);
+	frame->text = t;
 }
 
-/* Evict one page and return the corresponding frame.
- * Return NULL on error.*/
+/* Drops the text page cache entry of FRAME, which is about to hold
+ * something else. */
+static void
+text_page_forget (struct frame *frame) {
+	if (frame->text == NULL)
+		return;
+	hash_delete (&text_pages, &frame->text->elem);
+	free (frame->text);
+	frame->text = NULL;
+}
+
+/* Allocates the frame table, covering the whole user pool. */
+static void
+frame_table_init (void) {
+	size_t bytes;
+
+	frame_base = palloc_user_pool (&frame_cnt);
+	bytes = frame_cnt * sizeof *frame_table;
+	frame_table = palloc_get_multiple (PAL_ASSERT | PAL_ZERO,
+			DIV_ROUND_UP (bytes, PGSIZE));
+	for (size_t i = 0; i < frame_cnt; i++)
+		frame_table[i].kva = frame_base + i * PGSIZE;
+	zero_frame.kva = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+	locked_max = frame_cnt / 2;
+	if (!hash_init (&text_pages, text_page_hash, text_page_less, NULL))
+		PANIC ("out of memory for the text page cache");
+	lock_init (&frame_lock);
+	cond_init (&frame_idle);
+}
+
+/* Returns the frame table entry of user pool page KVA. */
 static struct frame *
-vm_evict_frame (void) {
-	struct frame *victim UNUSED = vm_get_victim ();
-	/* TODO: swap out the victim and return the evicted frame. */
+frame_of (const void *kva) {
+	size_t idx = ((const uint8_t *) kva - frame_base) / PGSIZE;
 
-	return NULL;
+	ASSERT (idx < frame_cnt);
+	return &frame_table[idx];
 }
 
-/* palloc() and get frame. If there is no available page, evict the page
- * and return it. This always return valid address. That is, if the user pool
- * memory is full, this function evicts the frame to get the available memory
- * space.*/
+/* Acquires the lock on the frame table, for code outside this file that
+ * walks it with vm_frame_at (). */
+void
+vm_frame_lock (void) {
+	lock_acquire (&frame_lock);
+}
+
+/* Releases the lock on the frame table. */
+void
+vm_frame_unlock (void) {
+	lock_release (&frame_lock);
+}
+
+/* Returns the number of frames in the frame table. */
+size_t
+vm_frame_cnt (void) {
+	return frame_cnt;
+}
+
+/* Returns frame IDX of the frame table. The caller must hold the lock. */
+struct frame *
+vm_frame_at (size_t idx) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+	ASSERT (idx < frame_cnt);
+
+	return &frame_table[idx];
+}
+
+/* Returns the frame under the clock hand and advances the hand. */
 static struct frame *
-vm_get_frame (void) {
-	struct frame *frame = NULL;
-	/* TODO: Fill this function. */
+clock_advance (void) {
+	struct frame *frame = &frame_table[clock_hand];
 
-	ASSERT (frame != NULL);
-	ASSERT (frame->page == NULL);
+	clock_hand = (clock_hand + 1) % frame_cnt;
 	return frame;
 }
 
-/* Growing the stack. */
+/* Does FRAME hold a page of a shared anonymous mapping? Then every page
+ * that maps it belongs to the same object. */
+static bool
+frame_is_shared (const struct frame *frame) {
+	return anon_shared_frame (frame->page) != NULL;
+}
+
+/* May FRAME be evicted on behalf of OWNER, a process over its resident
+ * page budget that must make room for itself, or of anyone if OWNER is
+ * NULL? Busy and pinned frames stay resident, as do those of locked
+ * pages. A frame is evicted from every page that maps it at once, so
+ * OWNER must own all of them. */
+static bool
+frame_evictable (const struct frame *frame, const struct thread *owner) {
+	if (frame->page == NULL || frame->busy || frame->pinned
+			|| frame->pin_cnt != 0)
+		return false;
+	for (struct page *p = frame->page; p != NULL; p = p->next_sharer)
+		if (p->locked || (owner != NULL && p->owner != owner))
+			return false;
+	return true;
+}
+
+/* Is PAGE's frame, if it shares one, meant to show every page that maps
+ * it the writes of the others? So it is for a page of a shared mapping,
+ * or of a file, which fork () leaves mapped in both processes. */
+static bool
+page_shares_writes (struct page *page) {
+	return VM_TYPE (page->operations->type) == VM_FILE
+		|| anon_shared_frame (page) != NULL;
+}
+
+/* May PAGE, which maps FRAME, write to it? Not while the frame is shared
+ * copy-on-write or in the text page cache. */
+static bool
+frame_writable_by (const struct frame *frame, struct page *page) {
+	return page->writable && frame->text == NULL
+		&& (frame->ref_cnt == 1 || page_shares_writes (page));
+}
+
+/* Waits, with frame_lock held, until the frame of PAGE, if any, is not
+ * busy. PAGE may have lost its frame by the time this returns. */
 static void
-vm_stack_growth (void *addr UNUSED) {
+frame_wait_idle (struct page *page) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	while (page->frame != NULL && page->frame->busy)
+		cond_wait (&frame_idle, &frame_lock);
 }
 
-/* Handle the fault on write_protected page */
+/* Marks FRAME busy and releases frame_lock, ahead of disk I/O on it. */
+static void
+frame_begin_io (struct frame *frame) {
+	ASSERT (!frame->busy);
+
+	frame->busy = true;
+	lock_release (&frame_lock);
+}
+
+/* Takes frame_lock back after the I/O started by frame_begin_io () and
+ * wakes whoever waits for FRAME. The caller must revalidate anything it
+ * looked at before. */
+static void
+frame_end_io (struct frame *frame) {
+	lock_acquire (&frame_lock);
+	frame->busy = false;
+	cond_broadcast (&frame_idle, &frame_lock);
+}
+
+/* Writes PAGE, which has an idle frame of its own, back with swap_out ()
+ * and frame_lock released. PAGE stays mapped. */
+static bool
+frame_swap_out (struct page *page) {
+	struct frame *frame = page->frame;
+	bool success;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	frame_begin_io (frame);
+	success = swap_out (page);
+	frame_end_io (frame);
+	return success;
+}
+
+/* Has FRAME's page been referenced, through any of the pages that map
+ * it, since the clock last looked? */
 static bool
-vm_handle_wp (struct page *page UNUSED) {
+frame_is_referenced (const struct frame *frame) {
+	if (frame->referenced)
+		return true;
+	for (struct page *p = frame->page; p != NULL; p = p->next_sharer)
+		if (pml4_is_accessed (p->owner->pml4, p->va))
+			return true;
+	return false;
 }
 
-/* Return true on success */
-bool
-vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr UNUSED,
-		bool user UNUSED, bool write UNUSED, bool not_present UNUSED) {
-	struct supplemental_page_table *spt UNUSED = &thread_current ()->spt;
-	struct page *page = NULL;
-	/* TODO: Validate the fault */
-	/* TODO: Your code goes here */
+/* Clears the accessed bit of PAGE, which is mapped, leaving the TLB entry
+ * to TLB. A page inside a 2 MB page shares one bit with the whole block,
+ * and splitting the block to clear just its own would give up the huge
+ * page. The block is taken as a unit instead: its bit is cleared, and
+ * the other frames in it are marked referenced, to be seen as such when
+ * the clock or the sampler gets to them. Returns the number of pages the
+ * bit stood for. */
+static size_t
+page_clear_accessed (struct page *page, struct tlb_gather *tlb) {
+	uint64_t *pml4 = page->owner->pml4;
+	uint8_t *base;
+	struct frame *first;
 
-	return vm_do_claim_page (page);
+	pml4_set_accessed_batch (pml4, page->va, false, tlb);
+	if (!pml4_is_huge_page (pml4, page->va))
+		return 1;
+	base = (uint8_t *) ((uint64_t) page->va & ~(PGSIZE_2M - 1));
+	first = frame_of (pml4_get_page (pml4, base));
+	for (size_t i = 0; i < SPT_ENTRY_CNT; i++)
+		if (first + i != page->frame)
+			first[i].referenced = true;
+	return SPT_ENTRY_CNT;
 }
 
-/* Free the page.
- * DO NOT MODIFY THIS FUNCTION. */
-void
-vm_dealloc_page (struct page *page) {
-	destroy (page);
-	free (page);
+/* Returns whether FRAME's page has been referenced since the last call and
+ * clears its accessed bits, leaving the TLB entries to TLB. */
+static bool
+frame_test_and_clear_accessed (struct frame *frame, struct tlb_gather *tlb) {
+	bool referenced = frame->referenced;
+
+	for (struct page *p = frame->page; p != NULL; p = p->next_sharer)
+		if (pml4_is_accessed (p->owner->pml4, p->va)) {
+			page_clear_accessed (p, tlb);
+			referenced = true;
+		}
+	frame->referenced = false;
+	return referenced;
 }
 
-/* Claim the page that allocate on VA. */
-bool
-vm_claim_page (void *va UNUSED) {
-	struct page *page = NULL;
-	/* TODO: Fill this function */
+/* Has FRAME's page been written, through any of the pages that map it,
+ * since it was brought in? */
+static bool
+frame_is_dirty (const struct frame *frame) {
+	for (struct page *p = frame->page; p != NULL; p = p->next_sharer)
+		if (pml4_is_dirty (p->owner->pml4, p->va))
+			return true;
+	return false;
+}
 
-	return vm_do_claim_page (page);
+/* Second chance: a referenced page gets its bit cleared and is skipped, so
+ * a victim is found within two sweeps of the hand. */
+static struct frame *
+clock_victim (struct thread *owner, struct tlb_gather *tlb) {
+	for (size_t i = 0; i < 2 * frame_cnt; i++) {
+		struct frame *frame = clock_advance ();
+
+		if (frame_evictable (frame, owner)
+				&& !frame_test_and_clear_accessed (frame, tlb))
+			return frame;
+	}
+	return NULL;
 }
 
-/* Claim the PAGE and set up the mmu. */
+/* Enhanced clock: orders pages by (accessed, dirty) and takes the first of
+ * the lowest class. The first sweep looks for an unreferenced clean page
+ * without touching any bit; the second takes any unreferenced page and
+ * clears the accessed bits it passes. Two rounds of that always succeed if
+ * anything is evictable. */
+static struct frame *
+eclock_victim (struct thread *owner, struct tlb_gather *tlb) {
+	for (int round = 0; round < 2; round++) {
+		for (size_t i = 0; i < frame_cnt; i++) {
+			struct frame *frame = clock_advance ();
+
+			if (frame_evictable (frame, owner) && !frame_is_referenced (frame)
+					&& !frame_is_dirty (frame))
+				return frame;
+		}
+		for (size_t i = 0; i < frame_cnt; i++) {
+			struct frame *frame = clock_advance ();
+
+			if (frame_evictable (frame, owner)
+					&& !frame_test_and_clear_accessed (frame, tlb))
+				return frame;
+		}
+	}
+	return NULL;
+}
+
+/* WSClock: a referenced page is stamped with the current tick and skipped.
+ * A page older than WSCLOCK_TAU has left the working set and is taken if
+ * clean. If one sweep finds no such page, falls back to the page that has
+ * been idle longest. */
+static struct frame *
+wsclock_victim (struct thread *owner, struct tlb_gather *tlb) {
+	int64_t now = timer_ticks ();
+	struct frame *oldest = NULL;
+
+	for (size_t i = 0; i < frame_cnt; i++) {
+		struct frame *frame = clock_advance ();
+
+		if (!frame_evictable (frame, owner))
+			continue;
+		if (frame_test_and_clear_accessed (frame, tlb)) {
+			frame->last_use = now;
+			continue;
+		}
+		if (now - frame->last_use > WSCLOCK_TAU && !frame_is_dirty (frame))
+			return frame;
+		if (oldest == NULL || frame->last_use < oldest->last_use)
+			oldest = frame;
+	}
+	return oldest;
+}
+
+/* Get the struct frame, that will be evicted: one of OWNER's, unless
+ * OWNER is NULL. The accessed bits the sweep clears are invalidated
+ * together once it stops. */
+static struct frame *
+vm_get_victim (struct thread *owner) {
+	struct tlb_gather tlb;
+	struct frame *victim;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	tlb_gather_init (&tlb, thread_current ()->pml4);
+	switch (evict_policy) {
+		case EVICT_ECLOCK:
+			victim = eclock_victim (owner, &tlb);
+			break;
+		case EVICT_WSCLOCK:
+			victim = wsclock_victim (owner, &tlb);
+			break;
+		case EVICT_CLOCK:
+		default:
+			victim = clock_victim (owner, &tlb);
+			break;
+	}
+	tlb_gather_finish (&tlb);
+	return victim;
+}
+
+/* Is FRAME's page private anonymous memory, which goes to swap in
+ * clusters? */
 static bool
-vm_do_claim_page (struct page *page) {
-	struct frame *frame = vm_get_frame ();
+frame_is_anon (const struct frame *frame) {
+	return VM_TYPE (frame->page->operations->type) == VM_ANON
+		&& !frame_is_shared (frame);
+}
 
-	/* Set links */
-	frame->page = page;
-	page->frame = frame;
+/* Frees the page table that maps PAGE, just evicted, if none of the pages
+ * that it covers, which share PAGE's SPT leaf, has a frame any more. */
+static void
+frame_discard_table (struct page *page) {
+	struct spt_leaf *leaf;
 
-	/* TODO: Insert page table entry to map page's VA to frame's PA. */
+	ASSERT (lock_held_by_current_thread (&frame_lock));
 
-	return swap_in (page, frame->kva);
+	if (page->owner->pml4 == NULL)
+		return;
+	leaf = spt_find_leaf (&page->owner->spt, page->va);
+	if (leaf == NULL)
+		return;
+	for (size_t i = 0; i < SPT_ENTRY_CNT; i++)
+		if (leaf->pages[i] != NULL && leaf->pages[i]->frame != NULL)
+			return;
+	if (pml4_discard_table (page->owner->pml4, page->va))
+		pt_discard_cnt++;
 }
 
-/* Initialize new supplemental page table */
-void
-supplemental_page_table_init (struct supplemental_page_table *spt UNUSED) {
+/* Is FRAME in the text page cache, with the contents its file still has,
+ * and was every page that maps it read from the file? Such a frame has
+ * never been written, since it is only ever mapped read-only.
+ * Dropping it changes the type of its pages, which code holding another
+ * thread's SPT lock, such as a fork () copying it, may be looking at
+ * without frame_lock. Frames with such pages do not qualify. */
+static bool
+frame_is_clean_text (const struct frame *frame) {
+	if (frame->text == NULL
+			|| frame->text->version != inode_version (frame->text->inode))
+		return false;
+	for (struct page *p = frame->page; p != NULL; p = p->next_sharer) {
+		struct thread *holder = p->owner->spt.lock.holder;
+
+		if (VM_TYPE (p->operations->type) != VM_ANON
+				|| p->anon.origin == NULL
+				|| (holder != NULL && holder != thread_current ()))
+			return false;
+	}
+	return true;
 }
 
-/* Copy supplemental page table from src to dst */
-bool
-supplemental_page_table_copy (struct supplemental_page_table *dst UNUSED,
-		struct supplemental_page_table *src UNUSED) {
+/* Evicts FRAME, which frame_is_clean_text (), without writing it anywhere:
+ * every page that maps it turns back into an unloaded VM_TEXT page, to be
+ * read from its file again, or found in the cache, by the next fault. */
+static struct frame *
+frame_drop_text (struct frame *frame) {
+	struct tlb_gather tlb;
+	struct page *next;
+
+	tlb_gather_init (&tlb, thread_current ()->pml4);
+	for (struct page *p = frame->page; p != NULL; p = p->next_sharer)
+		pml4_clear_page_batch (p->owner->pml4, p->va, &tlb);
+	tlb_gather_finish (&tlb);
+
+	for (struct page *p = frame->page; p != NULL; p = next) {
+		next = p->next_sharer;
+		p->frame = NULL;
+		p->next_sharer = NULL;
+		p->owner->spt.rss--;
+		anon_text_revert (p);
+		if (pt_discard)
+			frame_discard_table (p);
+	}
+	frame->page = NULL;
+	frame->ref_cnt = 0;
+	frame->referenced = false;
+	text_page_forget (frame);
+	text_drop_cnt++;
+	return frame;
 }
 
-/* Free the resource hold by the supplemental page table */
-void
-supplemental_page_table_kill (struct supplemental_page_table *spt UNUSED) {
-	/* TODO: Destroy all the supplemental_page_table hold by thread and
-	 * TODO: writeback all the modified contents to the storage. */
+/* Evict one page, of OWNER unless OWNER is NULL, and return the
+ * corresponding frame. Return NULL on error.
+ * An anonymous victim is written out together with up to EVICT_CLUSTER - 1
+ * further anonymous victims, so that swap sees one large sequential write
+ * instead of many small ones. The extra frames go back to the user pool.
+ * A frame that several pages map, copy-on-write or through a shared
+ * mapping, is unmapped from all of them and written out once: into a swap
+ * slot they all hold, or into the mapping's object. A clean frame of the
+ * text page cache is not written at all.
+ * frame_lock is released during the write, with the victims busy. */
+static struct frame *
+vm_evict_frame (struct thread *owner) {
+	struct frame *victims[EVICT_CLUSTER];
+	struct page *pages[EVICT_CLUSTER];
+	struct tlb_gather tlb;
+	bool anon;
+	size_t cnt;
+	bool success;
+
+	victims[0] = vm_get_victim (owner);
+	if (victims[0] == NULL)
+		return NULL;
+	if (frame_is_clean_text (victims[0]))
+		return frame_drop_text (victims[0]);
+	victims[0]->busy = true;
+	cnt = 1;
+	anon = frame_is_anon (victims[0]);
+	if (anon)
+		while (cnt < EVICT_CLUSTER) {
+			struct frame *frame = vm_get_victim (owner);
+
+			if (frame == NULL || !frame_is_anon (frame)
+					|| frame_is_clean_text (frame))
+				break;
+			frame->busy = true;
+			victims[cnt++] = frame;
+		}
+
+	/* Unmap first so the owners cannot change the pages while they are
+	 * being written out; a fault on one waits for its frame to go idle.
+	 * The dirty bit survives pml4_clear_page (). */
+	tlb_gather_init (&tlb, thread_current ()->pml4);
+	for (size_t i = 0; i < cnt; i++) {
+		pages[i] = victims[i]->page;
+		for (struct page *p = pages[i]; p != NULL; p = p->next_sharer)
+			pml4_clear_page_batch (p->owner->pml4, p->va, &tlb);
+	}
+	tlb_gather_finish (&tlb);
+	lock_release (&frame_lock);
+	if (anon)
+		success = anon_swap_out_cluster (pages, cnt);
+	else
+		success = swap_out (pages[0]);
+	lock_acquire (&frame_lock);
+
+	/* Busy frames are left alone, so the pages are as they were. */
+	for (size_t i = 0; i < cnt; i++) {
+		struct frame *frame = victims[i];
+		struct frame **shared = anon_shared_frame (pages[i]);
+		struct page *next;
+
+		frame->busy = false;
+		if (!success) {
+			for (struct page *p = pages[i]; p != NULL; p = p->next_sharer)
+				pml4_set_page (p->owner->pml4, p->va, frame->kva,
+						frame_writable_by (frame, p));
+			continue;
+		}
+		if (shared != NULL) {
+			*shared = NULL;
+			shared_evict_cnt++;
+		}
+		for (struct page *p = pages[i]; p != NULL; p = next) {
+			next = p->next_sharer;
+			p->frame = NULL;
+			p->next_sharer = NULL;
+			p->owner->spt.rss--;
+			if (pt_discard && p != pages[i])
+				frame_discard_table (p);
+		}
+		frame->page = NULL;
+		frame->ref_cnt = 0;
+		frame->referenced = false;
+		text_page_forget (frame);
+		if (i > 0)
+			palloc_free_page (frame->kva);
+	}
+	if (success && pt_discard)
+		for (size_t i = 0; i < cnt; i++)
+			frame_discard_table (pages[i]);
+	cond_broadcast (&frame_idle, &frame_lock);
+	return success ? victims[0] : NULL;
+}
+
+/* palloc() and get frame. If there is no available page, evict the page
+ * and return it. If the user pool is full and nothing can be evicted,
+ * returns NULL. Eviction releases frame_lock for a while. */
+static struct frame *
+vm_get_frame (void) {
+	struct frame *frame = NULL;
+	void *kva = palloc_get_page (PAL_USER);
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (kva != NULL)
+		frame = frame_of (kva);
+	else {
+		frame = vm_evict_frame (NULL);
+		if (frame != NULL)
+			reclaim_fg_cnt++;
+	}
+
+	if (!reclaim_pending && palloc_user_free_cnt () < reclaim_low) {
+		reclaim_pending = true;
+		sema_up (&reclaim_sema);
+	}
+
+	if (frame != NULL)
+		frame->last_use = timer_ticks ();
+	ASSERT (frame == NULL || frame->page == NULL);
+	return frame;
+}
+
+/* If OWNER has reached its resident page budget, evicts a cluster of its
+ * own pages, so that it pays for its next frame itself instead of taking
+ * one from other processes. */
+static void
+frame_enforce_budget (struct thread *owner) {
+	struct frame *frame;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (owner->rss_limit == 0 || owner->spt.rss < owner->rss_limit)
+		return;
+	frame = vm_evict_frame (owner);
+	if (frame != NULL) {
+		palloc_free_page (frame->kva);
+		rss_evict_cnt++;
+	}
+}
+
+/* One pass of the working-set sampler: counts, per process, the pages
+ * referenced since the previous pass, and clears their accessed bits. */
+static void
+ws_sample (void) {
+	int64_t now = timer_ticks ();
+
+	lock_acquire (&frame_lock);
+	ws_gen++;
+	for (size_t i = 0; i < frame_cnt; i++) {
+		struct frame *frame = &frame_table[i];
+
+		for (struct page *page = frame->page; page != NULL;
+				page = page->next_sharer) {
+			struct supplemental_page_table *spt = &page->owner->spt;
+			uint64_t *pml4 = page->owner->pml4;
+
+			size_t cnt;
+
+			if (pml4 == NULL || !pml4_is_accessed (pml4, page->va))
+				continue;
+			cnt = page_clear_accessed (page, NULL);
+			frame->referenced = true;
+			frame->last_use = now;
+			if (spt->ws_gen != ws_gen) {
+				spt->ws_gen = ws_gen;
+				spt->ws_cnt = 0;
+			}
+			spt->ws_cnt += cnt;
+		}
+	}
+	lock_release (&frame_lock);
+}
+
+/* Returns the number of pages T referenced during the last sampling
+ * pass: an estimate of its working set. */
+size_t
+vm_working_set (struct thread *t) {
+	size_t cnt;
+
+	lock_acquire (&frame_lock);
+	cnt = t->spt.ws_gen == ws_gen ? t->spt.ws_cnt : 0;
+	lock_release (&frame_lock);
+	return cnt;
+}
+
+/* Called by thread_tick () in the timer interrupt, where frame_lock cannot
+ * be taken: every WS_SAMPLE_INTERVAL ticks, has reclaimd run the
+ * working-set sampler. */
+void
+vm_tick (void) {
+	if (!reclaim_ready || ++ws_ticks < WS_SAMPLE_INTERVAL)
+		return;
+	ws_ticks = 0;
+	ws_sample_due = true;
+	sema_up (&reclaim_sema);
+}
+
+/* Body of reclaimd: evicts pages, one cluster at a time, whenever woken
+ * by vm_get_frame (), until reclaim_high frames are free. frame_lock is
+ * dropped between clusters so that faults are not held up for long. Also
+ * runs the working-set sampler when vm_tick () asks for it. */
+static void
+reclaim_daemon (void *aux UNUSED) {
+	for (;;) {
+		bool done = false;
+
+		sema_down (&reclaim_sema);
+		if (ws_sample_due) {
+			ws_sample_due = false;
+			ws_sample ();
+		}
+		while (!done) {
+			struct frame *frame = NULL;
+
+			lock_acquire (&frame_lock);
+			if (palloc_user_free_cnt () < reclaim_high)
+				frame = vm_evict_frame (NULL);
+			if (frame != NULL) {
+				palloc_free_page (frame->kva);
+				reclaim_bg_cnt++;
+			} else {
+				reclaim_pending = false;
+				done = true;
+			}
+			lock_release (&frame_lock);
+		}
+	}
+}
+
+/* Sets the watermarks from the size of the user pool and starts
+ * reclaimd. */
+static void
+reclaim_init (void) {
+	reclaim_low = DIV_ROUND_UP (frame_cnt, 32);
+	reclaim_high = 2 * reclaim_low;
+	sema_init (&reclaim_sema, 0);
+	if (thread_create ("reclaimd", PRI_DEFAULT, reclaim_daemon, NULL)
+			== TID_ERROR)
+		PANIC ("cannot start the reclaim daemon");
+	reclaim_ready = true;
+}
+
+/* Adds PAGE to the pages sharing FRAME. */
+static void
+frame_link (struct frame *frame, struct page *page) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	page->frame = frame;
+	if (frame == &zero_frame) {
+		page->next_sharer = NULL;
+		return;
+	}
+	page->next_sharer = frame->page;
+	frame->page = page;
+	frame->ref_cnt++;
+	page->owner->spt.rss++;
+}
+
+/* Unmaps PAGE from its owner and drops its share of its frame. The frame
+ * goes back to the user pool once no page uses it, unless it holds a page
+ * of a shared mapping, whose object keeps it for the processes that have
+ * yet to fault the page in. */
+static void
+frame_release (struct page *page) {
+	struct frame *frame = page->frame;
+	struct frame **shared;
+	struct page **link;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+	ASSERT (frame != NULL);
+
+	if (page->owner->pml4 != NULL)
+		pml4_clear_page (page->owner->pml4, page->va);
+	if (frame == &zero_frame) {
+		page->frame = NULL;
+		return;
+	}
+	ASSERT (!frame->busy);
+	for (link = &frame->page; *link != page; link = &(*link)->next_sharer)
+		ASSERT (*link != NULL);
+	*link = page->next_sharer;
+	page->next_sharer = NULL;
+	page->frame = NULL;
+	page->owner->spt.rss--;
+
+	if (--frame->ref_cnt == 0) {
+		/* PIN_CNT is not reset: whoever pinned the frame unpins it. */
+		frame->pinned = false;
+		frame->referenced = false;
+		text_page_forget (frame);
+		shared = anon_shared_frame (page);
+		if (shared == NULL || *shared != frame)
+			palloc_free_page (frame->kva);
+	}
+}
+
+/* Unmaps PAGE, of a shared mapping, from its frame, like frame_release ().
+ * A frame that no page maps any more stays with the object, beyond the
+ * reach of eviction, which goes by pages. So the last page to let go of
+ * it saves its contents to the object's store, with frame_lock released
+ * and the frame busy, and frees it. If the store is full, the frame
+ * stays with the object. */
+static void
+frame_release_shared (struct page *page) {
+	struct frame **shared = anon_shared_frame (page);
+	struct frame *frame = page->frame;
+	bool saved;
+
+	ASSERT (shared != NULL);
+
+	frame_release (page);
+	if (frame == &zero_frame || frame->ref_cnt > 0 || *shared != frame)
+		return;
+	/* Faults on the page wait while the frame is busy; nothing can map
+	 * it meanwhile. */
+	frame_begin_io (frame);
+	saved = anon_shared_save (page, frame->kva);
+	frame_end_io (frame);
+	ASSERT (frame->ref_cnt == 0 && *shared == frame);
+	if (saved) {
+		*shared = NULL;
+		shared_save_cnt++;
+		palloc_free_page (frame->kva);
+	}
+}
+
+/* May the page of FRAME be merged into another frame? It must be its
+ * only page, private anonymous memory, and neither locked nor in use by
+ * the kernel. */
+static bool
+ksm_can_merge (const struct frame *frame) {
+	struct page *page = frame->page;
+
+	return page != NULL && frame->ref_cnt == 1 && !frame->busy
+		&& !frame->pinned && frame->pin_cnt == 0 && frame->text == NULL
+		&& VM_TYPE (page->operations->type) == VM_ANON
+		&& page->anon.shared == NULL && !page->locked
+		&& page->owner->pml4 != NULL;
+}
+
+/* May other pages be merged into FRAME? Its own pages must all be ones
+ * that could have been merged. */
+static bool
+ksm_can_share (const struct frame *frame) {
+	if (frame->page == NULL || frame->busy || frame->pinned
+			|| frame->pin_cnt != 0 || frame->text != NULL)
+		return false;
+	for (struct page *p = frame->page; p != NULL; p = p->next_sharer)
+		if (VM_TYPE (p->operations->type) != VM_ANON || p->anon.shared != NULL
+				|| p->locked || p->owner->pml4 == NULL)
+			return false;
+	return true;
+}
+
+/* Write-protects PAGE, so that its contents stay as they are while
+ * frame_lock is held. Returns false if PAGE is not mapped. */
+static bool
+ksm_protect (struct page *page) {
+	uint64_t *pte = pml4e_walk (page->owner->pml4, (uint64_t) page->va,
+			false);
+
+	if (pte == NULL || !(*pte & PTE_P))
+		return false;
+	pml4_set_writable (page->owner->pml4, page->va, false);
+	return true;
+}
+
+/* Gives PAGE, write-protected by ksm_protect () but not merged, back the
+ * access it had. */
+static void
+ksm_unprotect (struct page *page) {
+	uint64_t *pte = pml4e_walk (page->owner->pml4, (uint64_t) page->va,
+			false);
+
+	if (pte != NULL && (*pte & PTE_P))
+		pml4_set_writable (page->owner->pml4, page->va,
+				frame_writable_by (page->frame, page));
+}
+
+/* Moves PAGE, write-protected, onto FRAME, which holds the same contents,
+ * and frees its old frame. */
+static void
+ksm_merge (struct page *page, struct frame *frame) {
+	bool mapped;
+
+	frame_release (page);
+	frame_link (frame, page);
+	/* The page table is there, since PAGE was mapped. */
+	mapped = pml4_set_page (page->owner->pml4, page->va, frame->kva, false);
+	ASSERT (mapped);
+}
+
+/* Tries to merge the page of FRAME into another frame. */
+static void
+ksm_scan_frame (struct frame *frame) {
+	struct ksm_slot *slot;
+	struct frame *match;
+	unsigned sum;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (!ksm_can_merge (frame))
+		return;
+	ksm_scan_cnt++;
+	sum = hash_bytes (frame->kva, PGSIZE);
+	if (sum != frame->ksm_sum) {
+		/* Changed since the last visit, and likely to change again. */
+		frame->ksm_sum = sum;
+		return;
+	}
+
+	if (sum == ksm_zero_sum) {
+		if (!ksm_protect (frame->page))
+			return;
+		if (!memcmp (frame->kva, zero_frame.kva, PGSIZE)) {
+			ksm_merge (frame->page, &zero_frame);
+			ksm_zero_cnt++;
+		} else
+			ksm_unprotect (frame->page);
+		return;
+	}
+
+	slot = &ksm_table[sum % KSM_TABLE_SIZE];
+	match = slot->frame;
+	if (match != NULL && match != frame && slot->sum == sum
+			&& ksm_can_share (match) && ksm_protect (frame->page)) {
+		bool protected = true;
+
+		for (struct page *p = match->page; p != NULL; p = p->next_sharer)
+			protected = ksm_protect (p) && protected;
+		if (protected && !memcmp (frame->kva, match->kva, PGSIZE)) {
+			ksm_merge (frame->page, match);
+			ksm_merge_cnt++;
+			return;
+		}
+		/* Otherwise every write to these pages would fault. */
+		ksm_unprotect (frame->page);
+		for (struct page *p = match->page; p != NULL; p = p->next_sharer)
+			ksm_unprotect (p);
+	}
+	slot->frame = frame;
+	slot->sum = sum;
+}
+
+/* ksmd: merges identical anonymous pages, ksm_rate frames at a time. It
+ * runs at the lowest priority, so that it only uses idle time, and takes
+ * frame_lock one frame at a time. */
+static void
+ksm_daemon (void *aux UNUSED) {
+	for (;;) {
+		timer_sleep (KSM_INTERVAL);
+		for (size_t i = 0; i < ksm_rate; i++) {
+			lock_acquire (&frame_lock);
+			ksm_scan_frame (&frame_table[ksm_hand]);
+			ksm_hand = (ksm_hand + 1) % frame_cnt;
+			lock_release (&frame_lock);
+		}
+	}
+}
+
+/* Starts ksmd, if it is enabled. */
+static void
+ksm_init (void) {
+	if (ksm_rate == 0)
+		return;
+	ksm_zero_sum = hash_bytes (zero_frame.kva, PGSIZE);
+	if (thread_create ("ksmd", PRI_MIN, ksm_daemon, NULL) == TID_ERROR)
+		PANIC ("cannot start ksmd");
+}
+
+/* Unmaps PAGE from its owner and returns its frame to the user pool. */
+static void
+vm_free_frame (struct page *page) {
+	lock_acquire (&frame_lock);
+	frame_release (page);
+	lock_release (&frame_lock);
+}
+
+/* Returns true if a fault at ADDR is a plausible stack access by a thread
+ * whose user stack pointer is RSP: within STACK_LIMIT of USER_STACK and no
+ * further below RSP than a PUSH would reach. */
+static bool
+is_stack_access (const void *addr, const uint8_t *rsp) {
+	const uint8_t *p = addr;
+	return p < (uint8_t *) USER_STACK
+		&& p >= (uint8_t *) USER_STACK - STACK_LIMIT
+		&& p >= rsp - 8;
+}
+
+/* Growing the stack. */
+static void
+vm_stack_growth (void *addr) {
+	vm_alloc_page (VM_ANON, pg_round_down (addr), true);
+}
+
+/* Gives PAGE, mapped read-only to a frame it shares, a writable frame of
+ * its own. A page of a shared or file mapping, write-protected by
+ * fork (), is made writable again instead: its frame is meant to be
+ * shared. */
+static bool
+frame_unshare (struct page *page) {
+	struct frame *frame, *copy;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	for (;;) {
+		frame_wait_idle (page);
+		frame = page->frame;
+		if (frame == NULL) {
+			/* Evicted since the fault; the retried write faults it back in. */
+			return true;
+		}
+		if (frame->ref_cnt == 1 || page_shares_writes (page)) {
+			/* The other sharers are gone, so the frame is ours alone, or
+			 * they are meant to see our writes. A frame in the text page
+			 * cache is about to differ from the file, so no one else may
+			 * find it there any more. */
+			text_page_forget (frame);
+			pml4_set_writable (page->owner->pml4, page->va, true);
+			return true;
+		}
+
+		frame_enforce_budget (page->owner);
+		copy = vm_get_frame ();
+		if (copy == NULL)
+			return false;
+
+		/* Making room may have released frame_lock, and the other sharers
+		 * may have gone meanwhile, leaving FRAME evictable. */
+		if (page->frame == frame
+				&& (frame == &zero_frame || frame->ref_cnt > 1))
+			break;
+		palloc_free_page (copy->kva);
+	}
+
+	if (frame == &zero_frame)
+		memset (copy->kva, 0, PGSIZE);
+	else
+		memcpy (copy->kva, frame->kva, PGSIZE);
+	frame_release (page);
+	frame_link (copy, page);
+	return pml4_set_page (page->owner->pml4, page->va, copy->kva, true);
+}
+
+/* Handle the fault on write_protected page */
+static bool
+vm_handle_wp (struct page *page) {
+	bool success;
+
+	lock_acquire (&frame_lock);
+	success = frame_unshare (page);
+	lock_release (&frame_lock);
+	return success;
+}
+
+/* Is PAGE an anonymous page that has never been touched and so is all
+ * zeros? */
+static bool
+page_is_zero_fill (const struct page *page) {
+	return VM_TYPE (page->operations->type) == VM_UNINIT
+		&& VM_TYPE (page->uninit.type) == VM_ANON
+		&& page->uninit.init == NULL;
+}
+
+/* Maps PAGE, a zero-fill page being read, to the shared zero frame. The
+ * first write gives it a frame of its own through vm_handle_wp (), so a
+ * page that is only ever read costs no user pool frame and no memset. */
+static bool
+vm_map_zero_page (struct page *page) {
+	bool success;
+
+	lock_acquire (&frame_lock);
+	success = frame_share (&zero_frame, page);
+	lock_release (&frame_lock);
+	return success;
+}
+
+/* May PAGE become part of a huge page? It must be a writable anonymous
+ * page that holds nothing but zeros and has no frame of its own yet. */
+static bool
+page_is_huge_candidate (const struct page *page) {
+	return page->writable
+		&& (page_is_zero_fill (page) || page->frame == &zero_frame);
+}
+
+/* Backs the whole 2 MB block around PAGE, a zero-fill page being written,
+ * with 512 contiguous, aligned frames mapped by a single PDE, which saves
+ * the other 511 faults and most of the TLB misses of a sweep over the
+ * block. Every page of the block, that is of its SPT leaf, must be a
+ * candidate, and the user pool must have the frames free; nothing is
+ * evicted to make room. Returns false, having changed nothing visible,
+ * otherwise.
+ * The frames are ordinary frame table entries. The mmu splits the huge
+ * page into 4 kB pages once one of them is unmapped, evicted or shared
+ * copy-on-write, with a page table it sets aside when the huge page is
+ * mapped, so that the split cannot fail. */
+static bool
+vm_try_huge_page (struct page *page) {
+	struct thread *owner = page->owner;
+	uintptr_t *link = spt_leaf_link (&owner->spt, page->va, false);
+	uint8_t *base = (uint8_t *) ((uint64_t) page->va & ~(PGSIZE_2M - 1));
+	struct spt_leaf *leaf;
+	uint8_t *kva;
+	size_t i;
+
+	if (link == NULL || spt_link_cnt (*link) != SPT_ENTRY_CNT)
+		return false;
+	if (owner->rss_limit != 0
+			&& owner->spt.rss + SPT_ENTRY_CNT > owner->rss_limit)
+		return false;
+	leaf = spt_link_leaf (*link);
+	for (i = 0; i < SPT_ENTRY_CNT; i++)
+		if (leaf->pages[i] == NULL || !page_is_huge_candidate (leaf->pages[i]))
+			return false;
+
+	kva = palloc_get_aligned (PAL_USER | PAL_ZERO, SPT_ENTRY_CNT,
+			SPT_ENTRY_CNT);
+	if (kva == NULL)
+		return false;
+
+	lock_acquire (&frame_lock);
+	for (i = 0; i < SPT_ENTRY_CNT; i++) {
+		struct page *p = leaf->pages[i];
+		struct frame *frame = frame_of (kva + i * PGSIZE);
+
+		if (p->frame != NULL)
+			frame_release (p);
+		else if (!uninit_transmute (p, frame->kva))
+			break;
+		frame_link (frame, p);
+		frame->last_use = timer_ticks ();
+	}
+	if (i < SPT_ENTRY_CNT
+			|| !pml4_set_huge_page (owner->pml4, base, kva, true)) {
+		/* Pages already turned anonymous load as zeros later on. */
+		for (size_t j = i; j < SPT_ENTRY_CNT; j++)
+			palloc_free_page (kva + j * PGSIZE);
+		while (i-- > 0)
+			frame_release (leaf->pages[i]);
+		lock_release (&frame_lock);
+		return false;
+	}
+	huge_page_cnt++;
+	lock_release (&frame_lock);
+	return true;
+}
+
+/* Makes the frame of PAGE, if it has one of its own, look unused since
+ * long ago, so that every eviction policy takes it ahead of the rest.
+ * The TLB entry is left to TLB. */
+static void
+frame_age (struct page *page, struct tlb_gather *tlb) {
+	struct frame *frame = page->frame;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (frame == NULL || frame == &zero_frame || frame->ref_cnt != 1
+			|| frame->busy)
+		return;
+	pml4_set_accessed_batch (page->owner->pml4, page->va, false, tlb);
+	frame->referenced = false;
+	frame->last_use = 0;
+	advise_age_cnt++;
+}
+
+/* Ages the pages well behind PAGE, which a fault in a SEQUENTIAL range
+ * just loaded. The scan is not coming back for them, so they are the
+ * cheapest frames to give up. */
+static void
+vm_age_behind (struct page *page) {
+	struct supplemental_page_table *spt = &page->owner->spt;
+	uint8_t *va = page->va;
+	struct tlb_gather tlb;
+
+	lock_acquire (&frame_lock);
+	tlb_gather_init (&tlb, page->owner->pml4);
+	for (size_t i = SEQ_KEEP_BEHIND; i < SEQ_KEEP_BEHIND + SEQ_AGE_CNT; i++) {
+		struct page *p;
+
+		if ((uintptr_t) va < i * PGSIZE)
+			break;
+		p = spt_find_page (spt, va - i * PGSIZE);
+		if (p == NULL || p->advice != VM_ADV_SEQUENTIAL)
+			break;
+		frame_age (p, &tlb);
+	}
+	tlb_gather_finish (&tlb);
+	lock_release (&frame_lock);
+}
+
+/* Makes PAGE resident as a fault would, and if WRITE also writable
+ * through a frame of its own, so that neither kind of fault is left for
+ * the next access. */
+static bool
+frame_fault_in (struct page *page, bool write) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (write && !page->writable)
+		return false;
+	frame_wait_idle (page);
+	if (page->frame == NULL && !frame_claim (page))
+		return false;
+	if (write && (page->frame == &zero_frame || page->frame->ref_cnt > 1
+				|| page->frame->text != NULL))
+		return frame_unshare (page);
+	return true;
+}
+
+/* Faults in the pages in the LENGTH bytes at ADDR and keeps them resident
+ * until vm_unlock_range (), as mlock () does. Writable pages get a frame
+ * of their own right away, so not even a copy-on-write fault is left.
+ * Returns false if part of the range is unmapped, a page cannot be
+ * loaded, or more than locked_max pages would be locked; the pages locked
+ * before that stay locked. */
+bool
+vm_lock_range (void *addr, size_t length) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	uint8_t *upage = pg_round_down (addr);
+	size_t page_cnt = DIV_ROUND_UP (length + pg_ofs (addr), PGSIZE);
+	bool success = true;
+
+	lock_acquire (&spt->lock);
+	lock_acquire (&frame_lock);
+	for (size_t i = 0; i < page_cnt && success; i++) {
+		struct page *page = spt_find_page (spt, upage + i * PGSIZE);
+
+		if (page == NULL || (!page->locked && locked_cnt >= locked_max)
+				|| !frame_fault_in (page, page->writable))
+			success = false;
+		else if (!page->locked) {
+			page->locked = true;
+			locked_cnt++;
+		}
+	}
+	lock_release (&frame_lock);
+	lock_release (&spt->lock);
+	return success;
+}
+
+/* Lets the pages in the LENGTH bytes at ADDR be evicted again. Returns
+ * false if part of the range is unmapped. */
+bool
+vm_unlock_range (void *addr, size_t length) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	uint8_t *upage = pg_round_down (addr);
+	size_t page_cnt = DIV_ROUND_UP (length + pg_ofs (addr), PGSIZE);
+	bool success = true;
+
+	lock_acquire (&spt->lock);
+	lock_acquire (&frame_lock);
+	for (size_t i = 0; i < page_cnt; i++) {
+		struct page *page = spt_find_page (spt, upage + i * PGSIZE);
+
+		if (page == NULL)
+			success = false;
+		else if (page->locked) {
+			page->locked = false;
+			locked_cnt--;
+		}
+	}
+	lock_release (&frame_lock);
+	lock_release (&spt->lock);
+	return success;
+}
+
+/* Pins the SIZE bytes of user memory at BUFFER for a system call that is
+ * about to copy to them, if WRITE, or from them: loads them, growing the
+ * stack if need be, and keeps them resident until vm_unpin_buffer (PIN),
+ * so that the copy takes no page fault and eviction cannot pull a page
+ * out from under it. The buffer spans at most VM_PIN_MAX pages, whose
+ * frames are recorded in PIN. Returns false, pinning nothing, if part of
+ * the buffer is not mapped, or is read-only and WRITE is set. */
+bool
+vm_pin_buffer (const void *buffer, size_t size, bool write,
+		struct vm_pin *pin) {
+	struct thread *curr = thread_current ();
+	uint8_t *start = pg_round_down (buffer);
+	uint8_t *end = (uint8_t *) buffer + size;
+
+	ASSERT (DIV_ROUND_UP (end - start, PGSIZE) <= VM_PIN_MAX);
+
+	pin->cnt = 0;
+	lock_acquire (&curr->spt.lock);
+	for (uint8_t *va = start; va < end; va += PGSIZE) {
+		struct page *page = NULL;
+		bool success;
+
+		if (is_user_vaddr (va)) {
+			page = spt_find_page (&curr->spt, va);
+			if (page == NULL && is_stack_access (va > start ? va : buffer,
+						curr->user_rsp)) {
+				vm_stack_growth (va);
+				page = spt_find_page (&curr->spt, va);
+			}
+		}
+
+		lock_acquire (&frame_lock);
+		success = page != NULL && frame_fault_in (page, write);
+		if (success && page->frame != &zero_frame) {
+			page->frame->pin_cnt++;
+			pin->frames[pin->cnt++] = page->frame;
+			buffer_pin_cnt++;
+		}
+		lock_release (&frame_lock);
+		if (!success) {
+			lock_release (&curr->spt.lock);
+			vm_unpin_buffer (pin);
+			return false;
+		}
+	}
+	lock_release (&curr->spt.lock);
+	return true;
+}
+
+/* Unpins the frames that vm_pin_buffer () pinned into PIN. They are the
+ * frames recorded then, whatever the pages of the buffer map now. */
+void
+vm_unpin_buffer (struct vm_pin *pin) {
+	lock_acquire (&frame_lock);
+	for (size_t i = 0; i < pin->cnt; i++) {
+		ASSERT (pin->frames[i]->pin_cnt > 0);
+		pin->frames[i]->pin_cnt--;
+	}
+	pin->cnt = 0;
+	lock_release (&frame_lock);
+}
+
+/* Writes PAGE back to its file now, if it is resident, for msync ().
+ * frame_lock is released during the write. */
+bool
+vm_write_back (struct page *page) {
+	bool success = true;
+
+	lock_acquire (&frame_lock);
+	frame_wait_idle (page);
+	if (page->frame != NULL)
+		success = frame_swap_out (page);
+	lock_release (&frame_lock);
+	return success;
+}
+
+/* Drops PAGE from memory for madvise (DONTNEED). A writable anonymous
+ * page gives up its frame and its swap copy, unwritten, and reads back
+ * as zeros, except that a page of a shared mapping only stops mapping its
+ * frame and keeps its contents. A file-backed page is written back first
+ * and reads back from its file. Read-only pages, which may be shared text, and pages not
+ * loaded yet are left alone. Returns false if PAGE is locked or a
+ * write-back fails. */
+static bool
+vm_drop_page (struct page *page) {
+	bool success = true;
+
+	if (page->locked)
+		return false;
+	lock_acquire (&frame_lock);
+	frame_wait_idle (page);
+	switch (VM_TYPE (page->operations->type)) {
+		case VM_ANON:
+			if (!page->writable)
+				break;
+			if (page->frame != NULL && anon_shared_frame (page) != NULL)
+				frame_release_shared (page);
+			else if (page->frame != NULL)
+				frame_release (page);
+			anon_discard (page);
+			advise_drop_cnt++;
+			break;
+		case VM_FILE:
+			if (page->frame == NULL)
+				break;
+			success = frame_swap_out (page);
+			if (success && page->frame != NULL) {
+				frame_release (page);
+				advise_drop_cnt++;
+			}
+			break;
+		default:
+			break;
+	}
+	lock_release (&frame_lock);
+	return success;
+}
+
+/* Applies ADVICE to the pages in the LENGTH bytes at ADDR, which must be
+ * page aligned. RANDOM, SEQUENTIAL and NORMAL are remembered per page and
+ * steer readahead and eviction; WILLNEED loads the pages and DONTNEED
+ * drops them right away. Returns false if part of the range is not mapped
+ * or a page cannot be loaded or written back; the rest still takes the
+ * advice. */
+bool
+vm_advise (void *addr, size_t length, enum vm_advice advice) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	uint8_t *upage = addr;
+	bool success = true;
+
+	if (pg_ofs (addr) != 0)
+		return false;
+	lock_acquire (&spt->lock);
+	for (size_t i = 0; i < DIV_ROUND_UP (length, PGSIZE); i++) {
+		struct page *page = spt_find_page (spt, upage + i * PGSIZE);
+
+		if (page == NULL) {
+			success = false;
+			continue;
+		}
+		switch (advice) {
+			case VM_ADV_WILLNEED: {
+				struct vm_aux *aux;
+
+				/* A zero-fill page costs nothing to fault in later. */
+				if (page->frame != NULL || page_is_zero_fill (page))
+					break;
+				/* Load it like a fault, neighbours read ahead included. */
+				aux = vm_page_aux (page);
+				if (aux != NULL && aux->fault_around != NULL)
+					vm_aux_get (aux);
+				else
+					aux = NULL;
+				if (vm_do_claim_page (page))
+					advise_load_cnt++;
+				else
+					success = false;
+				if (aux != NULL) {
+					aux->fault_around (aux, page->va);
+					vm_aux_put (aux);
+				}
+				break;
+			}
+			case VM_ADV_DONTNEED:
+				if (!vm_drop_page (page))
+					success = false;
+				break;
+			default:
+				page->advice = advice;
+				break;
+		}
+	}
+	lock_release (&spt->lock);
+	return success;
+}
+
+/* Does ADDR lie in one of the current process's areas? The page there
+ * may not exist yet, as on the stack. */
+bool
+vm_is_mapped (const void *addr) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	bool mapped;
+
+	/* Looked up under the SPT lock, as fault handling does. */
+	lock_acquire (&spt->lock);
+	mapped = vma_find (&spt->vmas, addr) != NULL;
+	lock_release (&spt->lock);
+	return mapped;
+}
+
+/* Return true on success */
+bool
+vm_try_handle_fault (struct intr_frame *f, void *addr,
+		bool user, bool write, bool not_present) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	bool success;
+
+	if (addr == NULL || !is_user_vaddr (addr))
+		return false;
+
+	lock_acquire (&spt->lock);
+	success = vm_do_handle_fault (f, addr, user, write, not_present);
+	lock_release (&spt->lock);
+	return success;
+}
+
+/* Handles a fault at ADDR, a user address, with the SPT lock held. */
+static bool
+vm_do_handle_fault (struct intr_frame *f, void *addr,
+		bool user, bool write, bool not_present) {
+	struct thread *curr = thread_current ();
+	struct supplemental_page_table *spt = &curr->spt;
+	struct page *page = NULL;
+	struct vm_aux *aux;
+	bool is_text;
+	bool success;
+
+	page = spt_find_page (spt, addr);
+	if (page == NULL) {
+		/* A fault raised inside a system call does not carry the user rsp;
+		 * syscall_handler () saved it for us. */
+		uint8_t *rsp = user ? (uint8_t *) f->rsp : curr->user_rsp;
+		struct vma *vma = vma_find (&spt->vmas, addr);
+
+		/* Only the stack has room for pages that do not exist yet. */
+		if (vma == NULL || vma->type != VMA_STACK
+				|| !is_stack_access (addr, rsp))
+			return false;
+		vm_stack_growth (addr);
+		page = spt_find_page (spt, addr);
+		if (page == NULL)
+			return false;
+	}
+
+	if (!not_present)
+		return write && page->writable
+			&& (vm_try_huge_page (page) || vm_handle_wp (page));
+	if (write && !page->writable)
+		return false;
+
+	if (write && page_is_zero_fill (page) && vm_try_huge_page (page))
+		return true;
+
+	if (!write && page_is_zero_fill (page))
+		return vm_map_zero_page (page);
+
+	/* Loading the page may drop its reference on the aux, which the
+	 * fault-around below still needs. */
+	is_text = page_is_text (page);
+	aux = vm_page_aux (page);
+	if (aux != NULL && aux->fault_around != NULL)
+		vm_aux_get (aux);
+	else
+		aux = NULL;
+
+	success = vm_do_claim_page (page);
+
+	/* A text page is mapped read-only. Write to it now rather than in
+	 * another fault. */
+	if (success && write && is_text)
+		success = vm_handle_wp (page);
+	if (aux != NULL) {
+		aux->fault_around (aux, page->va);
+		vm_aux_put (aux);
+	}
+	if (success && page->advice == VM_ADV_SEQUENTIAL)
+		vm_age_behind (page);
+	return success;
+}
+
+/* Free the page.
+ * The page's frame, if any, is unmapped and returned to the user pool, and
+ * its slot in the supplemental page table is left empty. */
+void
+vm_dealloc_page (struct page *page) {
+	/* reclaimd must not write the page out while it is torn down. Only a
+	 * file-backed page needs its frame to be destroyed, for the write-back,
+	 * and that frame stays pinned meanwhile. If another process still maps
+	 * the frame, the page leaves the write-back to it, along with its
+	 * dirty bit, and lets go of the frame first, as any other page does.
+	 * A page of a shared mapping does so while it still holds its object,
+	 * where the page is kept for the other processes. */
+	lock_acquire (&frame_lock);
+	frame_wait_idle (page);
+	if (page->frame != NULL) {
+		if (VM_TYPE (page->operations->type) == VM_FILE
+				&& page->frame->ref_cnt > 1) {
+			struct page *heir = page->frame->page != page
+				? page->frame->page : page->next_sharer;
+
+			if (pml4_is_dirty (page->owner->pml4, page->va))
+				pml4_set_dirty (heir->owner->pml4, heir->va, true);
+			frame_release (page);
+		} else if (VM_TYPE (page->operations->type) == VM_FILE)
+			page->frame->pinned = true;
+		else if (anon_shared_frame (page) != NULL)
+			frame_release_shared (page);
+		else
+			frame_release (page);
+	}
+	if (page->locked)
+		locked_cnt--;
+	lock_release (&frame_lock);
+
+	destroy (page);
+	if (page->frame != NULL)
+		vm_free_frame (page);
+	memset (page, 0, sizeof *page);
+}
+
+/* Claim the page that allocate on VA. */
+bool
+vm_claim_page (void *va) {
+	struct page *page = spt_find_page (&thread_current ()->spt, va);
+
+	if (page == NULL)
+		return false;
+	return vm_do_claim_page (page);
+}
+
+/* Claim the PAGE and set up the mmu. */
+static bool
+vm_do_claim_page (struct page *page) {
+	bool success;
+
+	lock_acquire (&frame_lock);
+	success = frame_claim (page);
+	lock_release (&frame_lock);
+	return success;
+}
+
+/* Maps PAGE, still uninit, read-only onto FRAME, which already holds what
+ * PAGE would be initialized to. */
+static bool
+frame_share (struct frame *frame, struct page *page) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (!uninit_transmute (page, frame->kva))
+		return false;
+	frame_link (frame, page);
+	if (!pml4_set_page (page->owner->pml4, page->va, frame->kva, false)) {
+		frame_release (page);
+		return false;
+	}
+	return true;
+}
+
+/* Maps PAGE, of a shared mapping, onto FRAME, which holds the page of its
+ * object, writable if PAGE is. */
+static bool
+frame_join (struct frame *frame, struct page *page) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (VM_TYPE (page->operations->type) == VM_UNINIT
+			&& !uninit_transmute (page, frame->kva))
+		return false;
+	frame_link (frame, page);
+	if (!pml4_set_page (page->owner->pml4, page->va, frame->kva,
+				page->writable)) {
+		frame_release_shared (page);
+		return false;
+	}
+	shared_join_cnt++;
+	return true;
+}
+
+/* Does the work of vm_do_claim_page () with the frame table locked. */
+static bool
+frame_claim (struct page *page) {
+	struct text_page key;
+	bool is_text = text_page_key (page, &key);
+	struct frame **shared = anon_shared_frame (page);
+	struct frame *frame;
+	bool success;
+
+	/* Faulted in by someone else, or put back by a failed eviction, while
+	 * we waited for frame_lock. A page on its way out is waited for. */
+	frame_wait_idle (page);
+	if (page->frame != NULL)
+		return true;
+
+	/* Another process running the same program may have this page. */
+	if (is_text) {
+		while ((frame = text_page_lookup (&key)) != NULL && frame->busy)
+			cond_wait (&frame_idle, &frame_lock);
+		if (frame != NULL) {
+			if (!frame_share (frame, page))
+				return false;
+			text_share_cnt++;
+			return true;
+		}
+	}
+
+	/* Another process mapping the same object may have this page. */
+	if (shared != NULL) {
+		while (*shared != NULL && (*shared)->busy)
+			cond_wait (&frame_idle, &frame_lock);
+		if (*shared != NULL)
+			return frame_join (*shared, page);
+	}
+
+	frame_enforce_budget (page->owner);
+	frame = vm_get_frame ();
+	if (frame == NULL)
+		return false;
+
+	/* Making room may have released frame_lock. */
+	frame_wait_idle (page);
+	if (page->frame != NULL) {
+		palloc_free_page (frame->kva);
+		return true;
+	}
+	if (shared != NULL && *shared != NULL) {
+		palloc_free_page (frame->kva);
+		return frame_claim (page);
+	}
+
+	/* Set links. A fault on the same page of a shared object in another
+	 * process finds the frame busy from now on, and waits for it. */
+	frame_link (frame, page);
+	if (shared != NULL)
+		*shared = frame;
+
+	/* Fill the frame before it becomes visible to the user, without
+	 * frame_lock: a fault waiting for the disk holds up no one else's. */
+	frame_begin_io (frame);
+	success = swap_in (page, frame->kva);
+	frame_end_io (frame);
+	/* A text page is read-only while the cache may hand its frame out. */
+	if (!success || !pml4_set_page (page->owner->pml4, page->va, frame->kva,
+				page->writable && !is_text)) {
+		if (shared != NULL)
+			*shared = NULL;
+		frame_release (page);
+		return false;
+	}
+	/* Another process may have loaded the same text page meanwhile. */
+	if (is_text) {
+		if (text_page_lookup (&key) == NULL)
+			text_page_remember (frame, &key);
+		text_load_cnt++;
+	}
+	return true;
+}
+
+/* Initialize new supplemental page table */
+void
+supplemental_page_table_init (struct supplemental_page_table *spt) {
+	lock_init (&spt->lock);
+	spt_clear (spt);
+}
+
+/* Resets SPT to an empty table. */
+static void
+spt_clear (struct supplemental_page_table *spt) {
+	spt->root = NULL;
+	list_init (&spt->slabs);
+	vma_tree_init (&spt->vmas);
+	spt->page_cnt = 0;
+	spt->rss = 0;
+	spt->ws_cnt = 0;
+	spt->ws_gen = 0;
+}
+
+/* Duplicates SRC, a page of the parent, into the current thread's table. */
+static bool
+spt_copy_page (struct page *src, void *aux UNUSED) {
+	struct supplemental_page_table *dst = &thread_current ()->spt;
+	struct page *page;
+
+	/* A page never touched by the parent stays lazy in the child. */
+	if (VM_TYPE (src->operations->type) == VM_UNINIT) {
+		page = spt_reserve (dst, src->va);
+		if (page == NULL)
+			return false;
+		*page = *src;
+		page->owner = thread_current ();
+		page->locked = false;
+		if (src->uninit.type & VM_AUX_REF)
+			vm_aux_get (src->uninit.aux);
+		return true;
+	}
+
+	bool success = true;
+
+	/* A file-backed page in memory maps the same frame in the child, as
+	 * a page of a shared mapping does, so that neither has to write it
+	 * back for the other to see it. Otherwise the child loads it from
+	 * the file on the first fault, as the parent would. */
+	if (VM_TYPE (src->operations->type) == VM_FILE) {
+		lock_acquire (&frame_lock);
+		frame_wait_idle (src);
+		page = spt_reserve (dst, src->va);
+		if (page == NULL) {
+			lock_release (&frame_lock);
+			return false;
+		}
+		*page = *src;
+		page->owner = thread_current ();
+		page->locked = false;
+		page->frame = NULL;
+		page->next_sharer = NULL;
+		vm_aux_get (&src->file.region->aux);
+		if (src->frame != NULL) {
+			frame_link (src->frame, page);
+			success = pml4_set_page (page->owner->pml4, page->va,
+					page->frame->kva, page->writable);
+			fork_file_cnt++;
+		}
+		lock_release (&frame_lock);
+		return success;
+	}
+
+	ASSERT (VM_TYPE (src->operations->type) == VM_ANON);
+
+	/* A page of a shared mapping maps the same frame writable in the
+	 * child, if it is in memory, and otherwise finds it through its
+	 * object on the first fault. */
+	if (src->anon.shared != NULL) {
+		lock_acquire (&frame_lock);
+		frame_wait_idle (src);
+		page = spt_reserve (dst, src->va);
+		if (page == NULL) {
+			lock_release (&frame_lock);
+			return false;
+		}
+		*page = *src;
+		page->owner = thread_current ();
+		page->locked = false;
+		page->frame = NULL;
+		page->next_sharer = NULL;
+		vm_aux_get (&src->anon.shared->aux);
+		if (src->frame != NULL) {
+			frame_link (src->frame, page);
+			success = pml4_set_page (page->owner->pml4, page->va,
+					page->frame->kva, page->writable);
+		}
+		lock_release (&frame_lock);
+		return success;
+	}
+
+	/* Anonymous pages are shared copy-on-write: both sides map the frame
+	 * read-only, and vm_handle_wp () copies it on the first write. A page
+	 * that is swapped out stays there: the child takes a hold on its swap
+	 * slot, or a copy of it in the compressed tier, and reads it in on
+	 * its first fault, if ever. Only if the tier is full is the page
+	 * brought back to be shared in memory instead. */
+
+	lock_acquire (&frame_lock);
+	frame_wait_idle (src);
+	page = spt_reserve (dst, src->va);
+	if (page == NULL) {
+		lock_release (&frame_lock);
+		return false;
+	}
+	/* Like Linux, the child does not inherit mlock (). */
+	*page = *src;
+	page->owner = thread_current ();
+	page->locked = false;
+	page->frame = NULL;
+	page->next_sharer = NULL;
+	if (page->anon.origin != NULL)
+		vm_aux_get (&page->anon.origin->aux);
+	if (src->frame == NULL) {
+		if (anon_copy_store (page, src)) {
+			if (page->anon.slot != SWAP_SLOT_NONE || page->anon.zswap.len > 0)
+				fork_swap_cnt++;
+			lock_release (&frame_lock);
+			return true;
+		}
+		if (!frame_claim (src)) {
+			lock_release (&frame_lock);
+			return false;
+		}
+	}
+	frame_link (src->frame, page);
+	success = pml4_set_page (page->owner->pml4, page->va, page->frame->kva,
+			false);
+	lock_release (&frame_lock);
+	return success;
+}
+
+/* Copy supplemental page table from src to dst.
+ * The parent's pages are write-protected in one sweep of its page table
+ * once they are all shared. It is waiting for the fork to finish, so it
+ * cannot write to them meanwhile. */
+bool
+supplemental_page_table_copy (struct supplemental_page_table *dst,
+		struct supplemental_page_table *src) {
+	struct thread *parent = thread_current ()->parent;
+	bool success;
+
+	ASSERT (dst == &thread_current ()->spt);
+	ASSERT (src == &parent->spt);
+
+	lock_acquire (&src->lock);
+	success = vma_tree_copy (&dst->vmas, &src->vmas)
+		&& spt_for_each (src, spt_copy_page, NULL);
+	lock_acquire (&frame_lock);
+	pml4_protect_range (parent->pml4, NULL, (void *) KERN_BASE, false, NULL);
+	lock_release (&frame_lock);
+	lock_release (&src->lock);
+	return success;
+}
+
+/* spt_for_each () helper for supplemental_page_table_kill (). */
+static bool
+spt_kill_page (struct page *page, void *aux UNUSED) {
+	vm_dealloc_page (page);
+	return true;
+}
+
+/* Free the resource hold by the supplemental page table.
+ * Everything is unmapped up front, so that the TLB is flushed once rather
+ * than a page at a time as each page is freed. */
+void
+supplemental_page_table_kill (struct supplemental_page_table *spt) {
+	struct thread *owner = thread_current ();
+	struct tlb_gather tlb;
+
+	ASSERT (spt == &owner->spt);
+
+	lock_acquire (&spt->lock);
+	if (owner->pml4 != NULL) {
+		lock_acquire (&frame_lock);
+		tlb_gather_init (&tlb, owner->pml4);
+		pml4_clear_range (owner->pml4, NULL, (void *) KERN_BASE, &tlb);
+		tlb_gather_finish (&tlb);
+		lock_release (&frame_lock);
+	}
+	spt_for_each (spt, spt_kill_page, NULL);
+	if (spt->root != NULL)
+		spt_dir_destroy (spt, spt->root, 0);
+	vma_tree_destroy (&spt->vmas);
+	spt_clear (spt);
+	lock_release (&spt->lock);
 }
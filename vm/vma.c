@@ -0,0 +1,274 @@
+/* vma.c: Virtual memory areas of a process, in an AVL tree. */
+
+#include "vm/vma.h"
+#include <debug.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "vm/vm.h"
+
+static int
+vma_height (const struct vma *vma) {
+	return vma != NULL ? vma->height : 0;
+}
+
+static void
+vma_update (struct vma *vma) {
+	int l = vma_height (vma->left), r = vma_height (vma->right);
+
+	vma->height = (l > r ? l : r) + 1;
+}
+
+static struct vma *
+rotate_right (struct vma *vma) {
+	struct vma *l = vma->left;
+
+	vma->left = l->right;
+	l->right = vma;
+	vma_update (vma);
+	vma_update (l);
+	return l;
+}
+
+static struct vma *
+rotate_left (struct vma *vma) {
+	struct vma *r = vma->right;
+
+	vma->right = r->left;
+	r->left = vma;
+	vma_update (vma);
+	vma_update (r);
+	return r;
+}
+
+/* Restores the AVL balance at VMA, whose subtrees are balanced and differ
+ * in height by at most two, and returns the new root of the subtree. */
+static struct vma *
+rebalance (struct vma *vma) {
+	int balance = vma_height (vma->left) - vma_height (vma->right);
+
+	if (balance > 1) {
+		if (vma_height (vma->left->left) < vma_height (vma->left->right))
+			vma->left = rotate_left (vma->left);
+		return rotate_right (vma);
+	}
+	if (balance < -1) {
+		if (vma_height (vma->right->right) < vma_height (vma->right->left))
+			vma->right = rotate_right (vma->right);
+		return rotate_left (vma);
+	}
+	vma_update (vma);
+	return vma;
+}
+
+static struct vma *
+avl_insert (struct vma *root, struct vma *vma) {
+	if (root == NULL)
+		return vma;
+	if (vma->start < root->start)
+		root->left = avl_insert (root->left, vma);
+	else
+		root->right = avl_insert (root->right, vma);
+	return rebalance (root);
+}
+
+/* Unlinks the leftmost node of ROOT into *MIN and returns what is left. */
+static struct vma *
+avl_remove_min (struct vma *root, struct vma **min) {
+	if (root->left == NULL) {
+		*min = root;
+		return root->right;
+	}
+	root->left = avl_remove_min (root->left, min);
+	return rebalance (root);
+}
+
+static struct vma *
+avl_remove (struct vma *root, struct vma *vma) {
+	ASSERT (root != NULL);
+
+	if (vma->start < root->start)
+		root->left = avl_remove (root->left, vma);
+	else if (vma->start > root->start)
+		root->right = avl_remove (root->right, vma);
+	else {
+		struct vma *min;
+
+		ASSERT (root == vma);
+		if (vma->right == NULL)
+			return vma->left;
+		vma->right = avl_remove_min (vma->right, &min);
+		min->left = vma->left;
+		min->right = vma->right;
+		root = min;
+	}
+	return rebalance (root);
+}
+
+/* Starts VMA's fault-around state afresh. */
+static void
+vma_readahead_init (struct vma *vma) {
+	vma->ra.next_fault = vma->start;
+	vma->ra.window = FAULT_AROUND_INIT;
+	vma->ra.ra_start = NULL;
+	vma->ra.ra_cnt = 0;
+	vma->ra.buffer = NULL;
+	vma->ra.buf_va = NULL;
+	vma->ra.buf_cnt = 0;
+	vma->ra.buf_version = 0;
+}
+
+/* Frees the pages read ahead for VMA, if any. */
+void
+vma_drop_buffer (struct vma *vma) {
+	if (vma->ra.buffer != NULL)
+		palloc_free_multiple (vma->ra.buffer, vma->ra.buf_cnt);
+	vma->ra.buffer = NULL;
+	vma->ra.buf_va = NULL;
+	vma->ra.buf_cnt = 0;
+}
+
+/* Frees VMA, dropping its reference on its region. */
+static void
+vma_free (struct vma *vma) {
+	vma_drop_buffer (vma);
+	if (vma->region != NULL)
+		vm_aux_put (&vma->region->aux);
+	free (vma);
+}
+
+/* Initializes TREE as empty. */
+void
+vma_tree_init (struct vma_tree *tree) {
+	tree->root = NULL;
+	tree->cnt = 0;
+}
+
+/* Returns a copy of the subtree SRC, or NULL if memory runs out, in which
+ * case *OK is set to false and whatever was copied is freed. */
+static struct vma *
+vma_copy (const struct vma *src, bool *ok) {
+	struct vma *vma;
+
+	if (src == NULL || !*ok)
+		return NULL;
+	vma = malloc (sizeof *vma);
+	if (vma == NULL) {
+		*ok = false;
+		return NULL;
+	}
+	*vma = *src;
+	vma_readahead_init (vma);
+	if (vma->region != NULL)
+		vm_aux_get (&vma->region->aux);
+	vma->left = vma_copy (src->left, ok);
+	vma->right = vma_copy (src->right, ok);
+	if (!*ok) {
+		struct vma_tree partial = { vma, 0 };
+
+		vma_tree_destroy (&partial);
+		return NULL;
+	}
+	return vma;
+}
+
+/* Makes DST, which must be empty, a copy of SRC, as fork () does. Returns
+ * false if memory runs out, leaving DST empty. */
+bool
+vma_tree_copy (struct vma_tree *dst, const struct vma_tree *src) {
+	bool ok = true;
+
+	ASSERT (dst->root == NULL);
+
+	dst->root = vma_copy (src->root, &ok);
+	dst->cnt = ok ? src->cnt : 0;
+	return ok;
+}
+
+static void
+vma_destroy (struct vma *vma) {
+	if (vma == NULL)
+		return;
+	vma_destroy (vma->left);
+	vma_destroy (vma->right);
+	vma_free (vma);
+}
+
+/* Frees every area in TREE and leaves it empty. */
+void
+vma_tree_destroy (struct vma_tree *tree) {
+	vma_destroy (tree->root);
+	vma_tree_init (tree);
+}
+
+/* Adds the area [START, END) of TYPE to TREE and returns it. REGION, if
+ * not NULL, is what backs it. Returns NULL if the range overlaps an area
+ * already in TREE, or if memory runs out. */
+struct vma *
+vma_insert (struct vma_tree *tree, void *start, void *end,
+		enum vma_type type, bool writable, struct file_region *region) {
+	struct vma *vma;
+
+	ASSERT (pg_ofs (start) == 0 && pg_ofs (end) == 0);
+	ASSERT (start < end);
+
+	if (vma_overlaps (tree, start, end))
+		return NULL;
+	vma = malloc (sizeof *vma);
+	if (vma == NULL)
+		return NULL;
+	vma->start = start;
+	vma->end = end;
+	vma->type = type;
+	vma->writable = writable;
+	vma->region = region;
+	vma_readahead_init (vma);
+	if (region != NULL)
+		vm_aux_get (&region->aux);
+	vma->left = vma->right = NULL;
+	vma->height = 1;
+	tree->root = avl_insert (tree->root, vma);
+	tree->cnt++;
+	return vma;
+}
+
+/* Takes VMA out of TREE and frees it. */
+void
+vma_remove (struct vma_tree *tree, struct vma *vma) {
+	tree->root = avl_remove (tree->root, vma);
+	tree->cnt--;
+	vma_free (vma);
+}
+
+/* Returns the area of TREE that covers ADDR, or NULL if there is none. */
+struct vma *
+vma_find (const struct vma_tree *tree, const void *addr) {
+	struct vma *vma = tree->root;
+
+	while (vma != NULL) {
+		if ((const uint8_t *) addr < vma->start)
+			vma = vma->left;
+		else if ((const uint8_t *) addr >= vma->end)
+			vma = vma->right;
+		else
+			return vma;
+	}
+	return NULL;
+}
+
+/* Does any area of TREE overlap [START, END)? */
+bool
+vma_overlaps (const struct vma_tree *tree, const void *start,
+		const void *end) {
+	struct vma *vma = tree->root;
+
+	while (vma != NULL) {
+		if ((const uint8_t *) end <= vma->start)
+			vma = vma->left;
+		else if ((const uint8_t *) start >= vma->end)
+			vma = vma->right;
+		else
+			return true;
+	}
+	return false;
+}
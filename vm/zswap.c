@@ -0,0 +1,349 @@
+/* zswap.c: Compressed in-memory tier in front of the swap disk.
+ *
+ * Anonymous pages on their way to swap are compressed into an arena of
+ * kernel pages first, and only spill to the disk when the arena is full or
+ * the page does not compress well. Swap-in from the arena is a memcpy and
+ * a decompression instead of a PIO round-trip to the disk.
+ *
+ * The compressor is a small LZ77 in the style of LZ4: a sequence is a
+ * token byte, holding the literal run length in its high nibble and the
+ * match length minus LZ_MIN_MATCH in its low nibble, the literals, then a
+ * 16-bit little-endian match offset. A nibble of 15 continues in the
+ * following bytes, each adding up to 255. The last sequence carries
+ * literals only. */
+
+#include "vm/zswap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* The arena is handed out in blocks of this many bytes. */
+#define ZSWAP_BLOCK_SIZE 64
+
+/* Pages compressed to more than this many bytes go to disk instead. */
+#define ZSWAP_MAX_LEN (PGSIZE * 3 / 4)
+
+/* Shortest match worth a back-reference, and the compressor's hash table
+ * size, in bits. */
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 12
+#define LZ_NO_POS UINT16_MAX
+
+/* Arena size in pages. Zero, the default, disables the tier. */
+static size_t zswap_pages;
+
+/* The arena, and its block allocator: a set bit marks a block in use. */
+static uint8_t *arena;
+static struct bitmap *block_map;
+
+/* Protects the block allocator, the list of free scratch spaces and the
+ * statistics. Pages are compressed and decompressed without it: a stored
+ * page is only ever loaded or freed by its owner. */
+static struct lock zswap_lock;
+
+/* Scratch space for one compression: the last position at which each
+ * 4-byte hash was seen, and the output of the compressor before it is
+ * known to fit. Too large for a kernel stack, so there are
+ * LZ_SCRATCH_CNT of them, taken one per compression in progress. */
+#define LZ_SCRATCH_CNT 4
+struct lz_scratch {
+	uint16_t table[1 << LZ_HASH_BITS];
+	uint8_t buffer[ZSWAP_MAX_LEN];
+};
+static struct lz_scratch *scratch_free[LZ_SCRATCH_CNT];
+static size_t scratch_free_cnt;
+static struct semaphore scratch_sema;  /* Counts SCRATCH_FREE. */
+
+/* Statistics. */
+static long long store_cnt;            /* Pages stored. */
+static long long load_cnt;             /* Pages loaded back. */
+static long long spill_full_cnt;       /* Pages refused, arena full. */
+static long long spill_poor_cnt;       /* Pages refused, compressed badly. */
+static long long stored_bytes;         /* Compressed bytes of stored pages. */
+
+/* Sets the size of the arena to PAGES pages. Must be called before
+ * zswap_init (). */
+void
+zswap_set_size (size_t pages) {
+	zswap_pages = pages;
+}
+
+/* Allocates the arena, unless the tier is disabled. */
+void
+zswap_init (void) {
+	size_t block_cnt = zswap_pages * (PGSIZE / ZSWAP_BLOCK_SIZE);
+
+	lock_init (&zswap_lock);
+	sema_init (&scratch_sema, 0);
+	if (zswap_pages == 0)
+		return;
+
+	arena = palloc_get_multiple (0, zswap_pages);
+	block_map = bitmap_create (block_cnt);
+	if (arena == NULL || block_map == NULL)
+		PANIC ("zswap: out of memory for a %zu page arena", zswap_pages);
+	for (size_t i = 0; i < LZ_SCRATCH_CNT; i++) {
+		scratch_free[i] = palloc_get_multiple (PAL_ASSERT,
+				DIV_ROUND_UP (sizeof (struct lz_scratch), PGSIZE));
+		sema_up (&scratch_sema);
+	}
+	scratch_free_cnt = LZ_SCRATCH_CNT;
+}
+
+/* Takes a scratch space, waiting for one to be free. */
+static struct lz_scratch *
+scratch_get (void) {
+	struct lz_scratch *s;
+
+	sema_down (&scratch_sema);
+	lock_acquire (&zswap_lock);
+	s = scratch_free[--scratch_free_cnt];
+	lock_release (&zswap_lock);
+	return s;
+}
+
+/* Gives back S, taken by scratch_get (). */
+static void
+scratch_put (struct lz_scratch *s) {
+	lock_acquire (&zswap_lock);
+	scratch_free[scratch_free_cnt++] = s;
+	lock_release (&zswap_lock);
+	sema_up (&scratch_sema);
+}
+
+/* Prints the tier's statistics. */
+void
+zswap_print_stats (void) {
+	if (arena == NULL)
+		return;
+	printf ("Zswap: %lld pages stored, %lld loaded, %lld spilled "
+			"(%lld full, %lld incompressible), %lld%% compressed size\n",
+			store_cnt, load_cnt, spill_full_cnt + spill_poor_cnt,
+			spill_full_cnt, spill_poor_cnt,
+			store_cnt > 0 ? stored_bytes * 100 / (store_cnt * PGSIZE) : 0);
+}
+
+static uint32_t
+lz_read32 (const uint8_t *p) {
+	uint32_t v;
+
+	memcpy (&v, p, sizeof v);
+	return v;
+}
+
+static size_t
+lz_hash (uint32_t v) {
+	return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Appends LEN to DST at *OP as the continuation of a length nibble. */
+static void
+lz_put_length (uint8_t *dst, size_t *op, size_t len) {
+	for (; len >= 255; len -= 255)
+		dst[(*op)++] = 255;
+	dst[(*op)++] = len;
+}
+
+/* Appends the sequence of the LIT_CNT literals at LIT and, if MATCH_LEN is
+ * nonzero, a match of MATCH_LEN bytes OFFSET bytes back, to DST at *OP.
+ * Returns false if DST, CAP bytes long, has no room for it. */
+static bool
+lz_put_sequence (uint8_t *dst, size_t *op, size_t cap, const uint8_t *lit,
+		size_t lit_cnt, size_t offset, size_t match_len) {
+	size_t match_code = match_len > 0 ? match_len - LZ_MIN_MATCH : 0;
+	size_t worst = 1 + lit_cnt / 255 + 1 + lit_cnt + 2 + match_code / 255 + 1;
+
+	if (*op + worst > cap)
+		return false;
+
+	dst[(*op)++] = ((lit_cnt < 15 ? lit_cnt : 15) << 4)
+		| (match_code < 15 ? match_code : 15);
+	if (lit_cnt >= 15)
+		lz_put_length (dst, op, lit_cnt - 15);
+	memcpy (dst + *op, lit, lit_cnt);
+	*op += lit_cnt;
+
+	if (match_len > 0) {
+		dst[(*op)++] = offset & 0xff;
+		dst[(*op)++] = offset >> 8;
+		if (match_code >= 15)
+			lz_put_length (dst, op, match_code - 15);
+	}
+	return true;
+}
+
+/* Compresses the page at SRC into the buffer of scratch space S. Returns
+ * the compressed size, or 0 if it would not fit. */
+static size_t
+lz_compress (const uint8_t *src, struct lz_scratch *s) {
+	uint8_t *dst = s->buffer;
+	size_t cap = sizeof s->buffer;
+	size_t ip = 0, anchor = 0, op = 0;
+
+	memset (s->table, 0xff, sizeof s->table);
+	while (ip + LZ_MIN_MATCH <= PGSIZE) {
+		size_t h = lz_hash (lz_read32 (src + ip));
+		size_t cand = s->table[h];
+		size_t len;
+
+		s->table[h] = ip;
+		if (cand == LZ_NO_POS || lz_read32 (src + cand) != lz_read32 (src + ip)) {
+			ip++;
+			continue;
+		}
+
+		for (len = LZ_MIN_MATCH; ip + len < PGSIZE; len++)
+			if (src[cand + len] != src[ip + len])
+				break;
+		if (!lz_put_sequence (dst, &op, cap, src + anchor, ip - anchor,
+					ip - cand, len))
+			return 0;
+		ip += len;
+		anchor = ip;
+	}
+	if (!lz_put_sequence (dst, &op, cap, src + anchor, PGSIZE - anchor, 0, 0))
+		return 0;
+	return op;
+}
+
+/* Reads the continuation of a length nibble from SRC at *IP. */
+static size_t
+lz_get_length (const uint8_t *src, size_t *ip) {
+	size_t len = 0;
+	uint8_t b;
+
+	do {
+		b = src[(*ip)++];
+		len += b;
+	} while (b == 255);
+	return len;
+}
+
+/* Decompresses the LEN bytes at SRC, made by lz_compress (), into the page
+ * at DST. */
+static void
+lz_decompress (const uint8_t *src, size_t len, uint8_t *dst) {
+	size_t ip = 0, op = 0;
+
+	while (ip < len) {
+		uint8_t token = src[ip++];
+		size_t lit_cnt = token >> 4;
+		size_t match_len = token & 0xf;
+		size_t offset;
+
+		if (lit_cnt == 15)
+			lit_cnt += lz_get_length (src, &ip);
+		ASSERT (op + lit_cnt <= PGSIZE);
+		memcpy (dst + op, src + ip, lit_cnt);
+		ip += lit_cnt;
+		op += lit_cnt;
+		if (ip >= len)
+			break;
+
+		offset = src[ip] | (src[ip + 1] << 8);
+		ip += 2;
+		if (match_len == 15)
+			match_len += lz_get_length (src, &ip);
+		match_len += LZ_MIN_MATCH;
+		ASSERT (offset > 0 && offset <= op && op + match_len <= PGSIZE);
+
+		/* Byte by byte: the match may overlap what it produces. */
+		for (; match_len > 0; match_len--, op++)
+			dst[op] = dst[op - offset];
+	}
+	ASSERT (op == PGSIZE);
+}
+
+/* Compresses the page at KVA into the arena and records where in *H.
+ * Returns false, storing nothing, if the tier is disabled or full, or the
+ * page compresses too poorly to be worth keeping in memory. */
+bool
+zswap_store (const void *kva, struct zswap_handle *h) {
+	struct lz_scratch *s;
+	size_t len, block = BITMAP_ERROR;
+
+	h->len = 0;
+	if (arena == NULL)
+		return false;
+
+	s = scratch_get ();
+	len = lz_compress (kva, s);
+	lock_acquire (&zswap_lock);
+	if (len == 0)
+		spill_poor_cnt++;
+	else {
+		block = bitmap_scan_and_flip (block_map, 0,
+				DIV_ROUND_UP (len, ZSWAP_BLOCK_SIZE), false);
+		if (block == BITMAP_ERROR)
+			spill_full_cnt++;
+		else {
+			memcpy (arena + block * ZSWAP_BLOCK_SIZE, s->buffer, len);
+			store_cnt++;
+			stored_bytes += len;
+		}
+	}
+	lock_release (&zswap_lock);
+	scratch_put (s);
+
+	if (block == BITMAP_ERROR)
+		return false;
+	h->block = block;
+	h->len = len;
+	return true;
+}
+
+/* Decompresses the page stored at *H into KVA. The page stays stored.
+ * Only the owner of *H may call this, so its blocks cannot be freed
+ * meanwhile. */
+void
+zswap_load (const struct zswap_handle *h, void *kva) {
+	ASSERT (h->len > 0);
+
+	lz_decompress (arena + h->block * ZSWAP_BLOCK_SIZE, h->len, kva);
+	lock_acquire (&zswap_lock);
+	load_cnt++;
+	lock_release (&zswap_lock);
+}
+
+/* Stores a second copy of the page stored at *SRC, still compressed, and
+ * records where in *DST. Returns false, storing nothing, if the arena is
+ * full. */
+bool
+zswap_copy (const struct zswap_handle *src, struct zswap_handle *dst) {
+	size_t block;
+
+	ASSERT (src->len > 0);
+
+	dst->len = 0;
+	lock_acquire (&zswap_lock);
+	block = bitmap_scan_and_flip (block_map, 0,
+			DIV_ROUND_UP (src->len, ZSWAP_BLOCK_SIZE), false);
+	if (block == BITMAP_ERROR) {
+		lock_release (&zswap_lock);
+		return false;
+	}
+	memcpy (arena + block * ZSWAP_BLOCK_SIZE,
+			arena + src->block * ZSWAP_BLOCK_SIZE, src->len);
+	dst->block = block;
+	dst->len = src->len;
+	lock_release (&zswap_lock);
+	return true;
+}
+
+/* Frees the space of the page stored at *H, if any. */
+void
+zswap_free (struct zswap_handle *h) {
+	if (h->len == 0)
+		return;
+
+	lock_acquire (&zswap_lock);
+	bitmap_set_multiple (block_map, h->block,
+			DIV_ROUND_UP (h->len, ZSWAP_BLOCK_SIZE), false);
+	lock_release (&zswap_lock);
+	h->len = 0;
+}